@@ -1,16 +1,21 @@
 from pathlib import Path
 import os
+import sys
 
 # Importa o módulo Tkinter para criar a interface gráfica
 from tkinter import Tk, Canvas, Button, PhotoImage
 
+# Binding da libsevenseg (lib/python no repositório): mantém o dispositivo aberto e troca quadros como inteiros
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "../../lib/python"))
+from sevenseg import Display
+
 # Declaração das constantes
 # Caminho para a pasta que contém as imagens dos botões
 ASSETS_PATH = Path(os.path.join(os.path.dirname(__file__), "assets/frame0"))
 # Caminho no sistema para o device criado pelo driver do display de 7 segmentos
 DEVICE_FILE = '/dev/sevenseg'
-# Palavras binárias que representam cada segmento individualmente (de A a G respectivamente)
-SEGMENT_BITS = [0b10000000, 0b01000000, 0b00100000, 0b00010000, 0b00001000, 0b00000100, 0b00000010]
+# Bits que representam cada segmento individualmente (de A a G respectivamente), na mesma ordem do driver (bit 0 = segmento A)
+SEGMENT_BITS = [1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6]
 
 def relative_to_assets(path: str) -> Path:
     """
@@ -27,20 +32,16 @@ def relative_to_assets(path: str) -> Path:
 
 def send_to_device(data: int):
     """
-    Envia um valor binário para o dispositivo do display
+    Envia o estado dos segmentos para o dispositivo do display
     de 7 segmentos.
 
     Parâmetros:
     data (int): Valor inteiro representando o estado binário dos segmentos.
     """
-    binary_string = bin(data)[2:].zfill(8)  # Converte o valor int 'data' para uma string binária de 8 bits, para alinhar com o que foi definido no driver
-                                            # A função bin(data) converte o inteiro para binário ('0b101'), e [2:] remove o prefixo '0b'
-                                            # A função .zfill(8) adiciona zeros à esquerda para garantir que a string final tenha 8 caracteres
     try:
-        # Abre o dispositivo e escreve a string binária exatamente como faríamos com o comando 'echo' no Terminal
-        with open(DEVICE_FILE, 'w') as device:
-            device.write(binary_string)
-    except IOError as e:
+        # O dispositivo já está aberto: o quadro vai direto como inteiro, sem montar a string binária
+        display.set([data])
+    except OSError as e:
         print(f"Erro ao escrever em {DEVICE_FILE}: {e}")
 
 def read_from_device() -> int:
@@ -51,12 +52,8 @@ def read_from_device() -> int:
     int: Valor inteiro representando o estado binário dos segmentos.
     """
     try:
-        # Lê 8 bits do dispositivo e converte de volta para um número inteiro
-        with open(DEVICE_FILE, 'rb') as device:
-            binary_string = device.read(8).decode().rstrip('\x00') + '0'    # Lê 8 bytes do dispositivo e converte para string com decode(), remove caracteres nulos à direita com rstrip().
-                                                                            # Adiciona '0' no final para garantir que a string final tenha 8 bits, evitando problemas de leitura incompleta.
-            return int(binary_string, 2)
-    except IOError as e:
+        return display.get()[0]     # Bitmap do primeiro dígito
+    except OSError as e:
         print(f"Erro ao ler de {DEVICE_FILE}: {e}")
         # Caso não seja possível ler do dispositivo, é melhor nem continuar rodando o programa
         exit()
@@ -149,6 +146,13 @@ canvas = Canvas(
 # Posiciona o canvas na janela da aplicação
 canvas.place(x=0, y=0)
 
+# Abre o dispositivo uma única vez; ele fica aberto enquanto a interface estiver rodando
+try:
+    display = Display(DEVICE_FILE)
+except OSError as e:
+    print(f"Erro ao abrir {DEVICE_FILE}: {e}")
+    exit()
+
 # Leitura do estado inicial do display e configuração dos botões
 segment_state = read_from_device()  # Armazena o estado atual dos segmentos no momento de inicialização da interface
 images = {}                         # Dicionário para armazenar as imagens associadas aos botões
@@ -0,0 +1,352 @@
+/**
+ * libsevenseg: implementação. Ver libsevenseg.h
+ *
+ * Compilação: make -C lib (gera libsevenseg.so)
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/map_to_7segment.h>
+#include <linux/map_to_14segment.h>
+
+#include "libsevenseg.h"
+
+#define DEFAULT_PATH "/dev/sevenseg"
+#define SEGMENT_TYPE_PARAM "/sys/module/sevenseg/parameters/segment_type"
+#define TEXT_MAX (SEVENSEG_MAX_DIGITS * (SEVENSEG_MAX_LINES + 1))  // Quadro em texto: linhas de cada dígito + separador/'\n'
+#define BATCH_FRAMES 256                                            // Quadros convertidos por writev() (abaixo de IOV_MAX)
+
+struct sevenseg {
+    int fd;
+    int interface;
+    int digits;         // Layout do display, lido do próprio dispositivo na abertura
+    int lines;
+    int segment_type;
+};
+
+static SEG7_DEFAULT_MAP(map_seg7);
+static SEG14_DEFAULT_MAP(map_seg14);
+
+/**
+ * Mesma conversão de 14 para 16 segmentos do driver: A e D divididos em duas metades
+ */
+static const uint32_t seg14_to_seg16[] = {
+    [BIT_SEG14_A] = 1 << 0 | 1 << 1,
+    [BIT_SEG14_B] = 1 << 2,
+    [BIT_SEG14_C] = 1 << 3,
+    [BIT_SEG14_D] = 1 << 4 | 1 << 5,
+    [BIT_SEG14_E] = 1 << 6,
+    [BIT_SEG14_F] = 1 << 7,
+    [BIT_SEG14_G1] = 1 << 8,
+    [BIT_SEG14_G2] = 1 << 9,
+    [BIT_SEG14_H] = 1 << 10,
+    [BIT_SEG14_I] = 1 << 11,
+    [BIT_SEG14_J] = 1 << 12,
+    [BIT_SEG14_K] = 1 << 13,
+    [BIT_SEG14_L] = 1 << 14,
+    [BIT_SEG14_M] = 1 << 15,
+};
+
+/**
+ * Lê o quadro em texto ("1110111 0110000") a partir do início do arquivo. O
+ * pread() evita reabrir o dispositivo: o driver só devolve dados no offset 0
+ */
+static int read_text(struct sevenseg *display, char *text) {
+    ssize_t len = pread(display->fd, text, TEXT_MAX, 0);
+
+    if (len < 0) {
+        return -errno;
+    }
+    if (len == 0) {
+        return -EIO;
+    }
+    text[len < TEXT_MAX ? len : TEXT_MAX - 1] = '\0';
+    return 0;
+}
+
+static void parse_text(const struct sevenseg *display, const char *text, uint64_t *segments, unsigned int digits) {
+    int digit = 0, segment = 0;
+
+    memset(segments, 0, digits * sizeof(*segments));
+    for (const char *c = text; *c != '\0' && *c != '\n'; c++) {
+        if (*c == ' ') {
+            if (++digit >= (int)digits) {
+                break;
+            }
+            segment = 0;
+            continue;
+        }
+        if (*c == '1' && segment < display->lines) {
+            segments[digit] |= 1ULL << segment;
+        }
+        segment++;
+    }
+}
+
+/**
+ * Monta um quadro completo em texto, terminado em '\n'. Todos os dígitos e linhas
+ * são escritos, então o quadro substitui o anterior por inteiro. Retorna o tamanho
+ */
+static size_t format_text(const struct sevenseg *display, const uint64_t *segments, unsigned int digits, char *text) {
+    size_t len = 0;
+
+    for (int d = 0; d < display->digits; d++) {
+        uint64_t value = d < (int)digits ? segments[d] : 0;
+
+        if (d > 0) {
+            text[len++] = ' ';
+        }
+        for (int i = 0; i < display->lines; i++) {
+            text[len++] = (value >> i) & 1 ? '1' : '0';
+        }
+    }
+    text[len++] = '\n';
+    return len;
+}
+
+static int read_segment_type(void) {
+    FILE *param = fopen(SEGMENT_TYPE_PARAM, "re");
+    int type = 7;
+
+    if (param) {
+        if (fscanf(param, "%d", &type) != 1) {
+            type = 7;
+        }
+        fclose(param);
+    }
+    return type;
+}
+
+struct sevenseg *sevenseg_open(const char *path) {
+    struct sevenseg_frame frame;
+    struct sevenseg *display;
+    char text[TEXT_MAX];
+    int ret;
+
+    display = calloc(1, sizeof(*display));
+    if (!display) {
+        return NULL;
+    }
+    display->fd = open(path ? path : DEFAULT_PATH, O_RDWR | O_CLOEXEC);
+    if (display->fd < 0) {
+        free(display);
+        return NULL;
+    }
+
+    // Interface mais rápida primeiro: sem os ioctls (ENOTTY) ficamos com o protocolo de texto
+    if (ioctl(display->fd, SEVENSEG_IOC_GET_FRAME, &frame) == 0) {
+        display->interface = SEVENSEG_IF_IOCTL;
+    } else if (errno == ENOTTY || errno == EINVAL) {
+        display->interface = SEVENSEG_IF_TEXT;
+    } else {
+        ret = -errno;
+        goto fail;
+    }
+
+    // O layout (dígitos e linhas por dígito) é o formato da string lida do dispositivo
+    ret = read_text(display, text);
+    if (ret) {
+        goto fail;
+    }
+    display->digits = 1;
+    display->lines = strcspn(text, " \n");
+    for (const char *c = text; *c != '\0' && *c != '\n'; c++) {
+        display->digits += *c == ' ';
+    }
+    if (display->lines == 0 || display->lines > SEVENSEG_MAX_LINES || display->digits > SEVENSEG_MAX_DIGITS) {
+        ret = -EPROTO;
+        goto fail;
+    }
+    display->segment_type = read_segment_type();
+    return display;
+
+fail:
+    close(display->fd);
+    free(display);
+    errno = -ret;
+    return NULL;
+}
+
+void sevenseg_close(struct sevenseg *display) {
+    if (display) {
+        close(display->fd);
+        free(display);
+    }
+}
+
+int sevenseg_interface(const struct sevenseg *display) {
+    return display->interface;
+}
+
+int sevenseg_digits(const struct sevenseg *display) {
+    return display->digits;
+}
+
+int sevenseg_lines(const struct sevenseg *display) {
+    return display->lines;
+}
+
+int sevenseg_segment_type(const struct sevenseg *display) {
+    return display->segment_type;
+}
+
+int sevenseg_set(struct sevenseg *display, const uint64_t *segments, unsigned int digits) {
+    char text[TEXT_MAX];
+    ssize_t written;
+    size_t len;
+
+    if (digits > SEVENSEG_MAX_DIGITS) {
+        return -EINVAL;
+    }
+    if (display->interface == SEVENSEG_IF_IOCTL) {
+        struct sevenseg_frame frame = { .seq = 0 };
+
+        memcpy(frame.segments, segments, digits * sizeof(*segments));
+        return ioctl(display->fd, SEVENSEG_IOC_SET_FRAME, &frame) < 0 ? -errno : 0;
+    }
+
+    len = format_text(display, segments, digits, text);
+    written = write(display->fd, text, len);
+    if (written != (ssize_t)len) {
+        return written < 0 ? -errno : -EIO;
+    }
+    return 0;
+}
+
+int sevenseg_get(struct sevenseg *display, uint64_t *segments, unsigned int digits, uint64_t *seq) {
+    char text[TEXT_MAX];
+    int ret;
+
+    if (digits > SEVENSEG_MAX_DIGITS) {
+        return -EINVAL;
+    }
+    if (display->interface == SEVENSEG_IF_IOCTL) {
+        struct sevenseg_frame frame;
+
+        if (ioctl(display->fd, SEVENSEG_IOC_GET_FRAME, &frame) < 0) {
+            return -errno;
+        }
+        memcpy(segments, frame.segments, digits * sizeof(*segments));
+        if (seq) {
+            *seq = frame.seq;
+        }
+        return 0;
+    }
+
+    ret = read_text(display, text);
+    if (ret) {
+        return ret;
+    }
+    parse_text(display, text, segments, digits);
+    if (seq) {
+        *seq = 0;
+    }
+    return 0;
+}
+
+/**
+ * Lotes vão sempre em texto, um quadro por iovec: uma syscall para até
+ * BATCH_FRAMES quadros custa menos que um ioctl por quadro, e as duas
+ * implementações do dispositivo aceitam esse formato
+ */
+int sevenseg_set_batch(struct sevenseg *display, const uint64_t *frames, unsigned int count, unsigned int digits) {
+    struct iovec iov[BATCH_FRAMES];
+    char *text;
+    int ret = 0;
+
+    if (digits > SEVENSEG_MAX_DIGITS) {
+        return -EINVAL;
+    }
+    text = malloc((size_t)BATCH_FRAMES * TEXT_MAX);
+    if (!text) {
+        return -ENOMEM;
+    }
+
+    while (count > 0) {
+        unsigned int n = count < BATCH_FRAMES ? count : BATCH_FRAMES;
+        size_t total = 0;
+        ssize_t written;
+
+        for (unsigned int i = 0; i < n; i++) {
+            iov[i].iov_base = text + total;
+            iov[i].iov_len = format_text(display, frames + (size_t)i * digits, digits, text + total);
+            total += iov[i].iov_len;
+        }
+        written = writev(display->fd, iov, n);
+        if (written != (ssize_t)total) {
+            ret = written < 0 ? -errno : -EIO;
+            break;
+        }
+        frames += (size_t)n * digits;
+        count -= n;
+    }
+    free(text);
+    return ret;
+}
+
+int sevenseg_wait_change(struct sevenseg *display, uint64_t seq, uint64_t *segments, unsigned int digits, uint64_t *new_seq) {
+    struct sevenseg_frame frame = { .seq = seq };
+
+    if (display->interface != SEVENSEG_IF_IOCTL) {
+        return -EOPNOTSUPP;
+    }
+    if (digits > SEVENSEG_MAX_DIGITS) {
+        return -EINVAL;
+    }
+    if (ioctl(display->fd, SEVENSEG_IOC_WAIT_CHANGE, &frame) < 0) {
+        return -errno;
+    }
+    memcpy(segments, frame.segments, digits * sizeof(*segments));
+    if (new_seq) {
+        *new_seq = frame.seq;
+    }
+    return 0;
+}
+
+uint64_t sevenseg_glyph(char c, int segment_type, int lines) {
+    uint64_t result = 0;
+    int segments;
+
+    // Mesma lógica de char_to_segments() no driver: sem a linha do ponto, o '.' segue para a tabela
+    if (c == '.' && lines > segment_type) {
+        return 1ULL << segment_type;
+    }
+    switch (segment_type) {
+    case 14:
+        segments = map_to_seg14(&map_seg14, c);
+        break;
+    case 16:
+        segments = map_to_seg14(&map_seg14, c);
+        for (unsigned int i = 0; i < sizeof(seg14_to_seg16) / sizeof(seg14_to_seg16[0]) && segments > 0; i++) {
+            if (segments & (1 << i)) {
+                result |= seg14_to_seg16[i];
+            }
+        }
+        return result;
+    default:
+        segments = map_to_seg7(&map_seg7, c);
+        break;
+    }
+    return segments < 0 ? 0 : segments;
+}
+
+void sevenseg_render_text(const char *text, int segment_type, int lines, uint64_t *segments, unsigned int digits) {
+    size_t len = strlen(text);
+
+    for (unsigned int d = 0; d < digits; d++) {
+        segments[d] = d < len ? sevenseg_glyph(text[d], segment_type, lines) : 0;
+    }
+}
+
+int sevenseg_set_text(struct sevenseg *display, const char *text) {
+    uint64_t segments[SEVENSEG_MAX_DIGITS];
+
+    sevenseg_render_text(text, display->segment_type, display->lines, segments, display->digits);
+    return sevenseg_set(display, segments, display->digits);
+}
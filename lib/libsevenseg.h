@@ -0,0 +1,86 @@
+/**
+ * libsevenseg: biblioteca para conversar com o /dev/sevenseg sem reimplementar o
+ * protocolo de texto em cada programa. O handle fica aberto entre as chamadas,
+ * os quadros são bitmaps (bit i = linha de segmento i, como em sevenseg.h) e a
+ * biblioteca escolhe sozinha a interface mais rápida que o módulo carregado tem:
+ *
+ *   ioctl - SET_FRAME/GET_FRAME binários, sem conversão para texto
+ *   texto - write()/pread() das strings "1110111 0110000", para módulos antigos
+ *           ou implementações que não têm os ioctls
+ *
+ * Lotes de quadros vão em um único writev() (o driver trata cada iovec como um quadro).
+ * As funções retornam 0 (ou um valor positivo) em caso de sucesso e -errno em caso de erro
+ */
+#ifndef LIBSEVENSEG_H
+#define LIBSEVENSEG_H
+
+#include <stdint.h>
+
+#include "sevenseg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct sevenseg;
+
+enum sevenseg_interface {
+    SEVENSEG_IF_TEXT,
+    SEVENSEG_IF_IOCTL,
+};
+
+/**
+ * Abre o dispositivo (NULL usa /dev/sevenseg) e descobre a interface, o número
+ * de dígitos e o de linhas por dígito. Retorna NULL com errno preenchido em caso de erro
+ */
+struct sevenseg *sevenseg_open(const char *path);
+void sevenseg_close(struct sevenseg *display);
+
+int sevenseg_interface(const struct sevenseg *display);
+int sevenseg_digits(const struct sevenseg *display);
+int sevenseg_lines(const struct sevenseg *display);
+int sevenseg_segment_type(const struct sevenseg *display);     // Parâmetro segment_type do módulo (7 se não for possível lê-lo)
+
+/**
+ * Aplica um quadro com 'digits' dígitos (os que faltarem ficam apagados)
+ */
+int sevenseg_set(struct sevenseg *display, const uint64_t *segments, unsigned int digits);
+
+/**
+ * Lê o quadro atual; 'seq' (opcional) recebe o número de sequência (0 na interface de texto)
+ */
+int sevenseg_get(struct sevenseg *display, uint64_t *segments, unsigned int digits, uint64_t *seq);
+
+/**
+ * Aplica 'count' quadros em sequência com uma única syscall. 'frames' tem
+ * count * digits bitmaps, quadro após quadro
+ */
+int sevenseg_set_batch(struct sevenseg *display, const uint64_t *frames, unsigned int count, unsigned int digits);
+
+/**
+ * Espera o número de sequência mudar de 'seq' e devolve o novo quadro (só na interface ioctl)
+ */
+int sevenseg_wait_change(struct sevenseg *display, uint64_t seq, uint64_t *segments, unsigned int digits, uint64_t *new_seq);
+
+/**
+ * Desenho de um caractere com as mesmas tabelas do driver (7, 14 ou 16
+ * segmentos). O '.' acende o ponto decimal quando 'lines' inclui a linha dele
+ */
+uint64_t sevenseg_glyph(char c, int segment_type, int lines);
+
+/**
+ * Desenha 'text' com um caractere por dígito, como o atributo 'text' do driver
+ * (dígitos sem caractere ficam apagados)
+ */
+void sevenseg_render_text(const char *text, int segment_type, int lines, uint64_t *segments, unsigned int digits);
+
+/**
+ * Desenha e aplica 'text' com o tipo de segmento e o número de linhas do display
+ */
+int sevenseg_set_text(struct sevenseg *display, const char *text);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBSEVENSEG_H */
@@ -0,0 +1,147 @@
+"""
+Binding Python (ctypes) da libsevenseg.
+
+O dispositivo fica aberto enquanto o objeto Display existir, e os quadros são
+listas de inteiros (um bitmap por dígito, bit 0 = segmento A), sem conversão
+para string a cada atualização:
+
+    with Display() as display:
+        display.set([0b0111111])
+        display.text("42")
+
+A biblioteca é procurada em $SEVENSEG_LIB, na pasta lib/ do repositório
+(depois de 'make -C lib') e por fim no caminho padrão do sistema.
+"""
+import ctypes
+import os
+from pathlib import Path
+
+MAX_DIGITS = 8      # SEVENSEG_MAX_DIGITS de sevenseg.h
+IF_TEXT = 0         # enum sevenseg_interface
+IF_IOCTL = 1
+
+
+def _load_library() -> ctypes.CDLL:
+    candidates = [
+        os.environ.get("SEVENSEG_LIB"),
+        str(Path(__file__).resolve().parent.parent / "libsevenseg.so"),
+        "libsevenseg.so",
+    ]
+    for candidate in candidates:
+        if not candidate:
+            continue
+        try:
+            return ctypes.CDLL(candidate, use_errno=True)
+        except OSError:
+            continue
+    raise OSError("libsevenseg.so nao encontrada (rode 'make -C lib' ou defina SEVENSEG_LIB)")
+
+
+_lib = _load_library()
+_u64_p = ctypes.POINTER(ctypes.c_uint64)
+
+_lib.sevenseg_open.argtypes = [ctypes.c_char_p]
+_lib.sevenseg_open.restype = ctypes.c_void_p
+_lib.sevenseg_close.argtypes = [ctypes.c_void_p]
+_lib.sevenseg_close.restype = None
+for _name in ("sevenseg_interface", "sevenseg_digits", "sevenseg_lines", "sevenseg_segment_type"):
+    getattr(_lib, _name).argtypes = [ctypes.c_void_p]
+    getattr(_lib, _name).restype = ctypes.c_int
+_lib.sevenseg_set.argtypes = [ctypes.c_void_p, _u64_p, ctypes.c_uint]
+_lib.sevenseg_get.argtypes = [ctypes.c_void_p, _u64_p, ctypes.c_uint, _u64_p]
+_lib.sevenseg_set_batch.argtypes = [ctypes.c_void_p, _u64_p, ctypes.c_uint, ctypes.c_uint]
+_lib.sevenseg_wait_change.argtypes = [ctypes.c_void_p, ctypes.c_uint64, _u64_p, ctypes.c_uint, _u64_p]
+_lib.sevenseg_set_text.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_lib.sevenseg_glyph.argtypes = [ctypes.c_char, ctypes.c_int, ctypes.c_int]
+_lib.sevenseg_glyph.restype = ctypes.c_uint64
+
+
+def _check(ret: int):
+    """
+    As funções da biblioteca retornam -errno em caso de erro
+    """
+    if ret < 0:
+        raise OSError(-ret, os.strerror(-ret))
+
+
+def glyph(char: str, segment_type: int = 7, lines: int = 7) -> int:
+    """
+    Bitmap de um caractere, com as mesmas tabelas do driver.
+    """
+    return _lib.sevenseg_glyph(char.encode("ascii", "replace")[:1], segment_type, lines)
+
+
+class Display:
+    """
+    Handle persistente para o /dev/sevenseg (ou outro caminho, como um
+    dispositivo CUSE). Usa os ioctls binários quando o módulo os oferece.
+    """
+
+    def __init__(self, path: str = "/dev/sevenseg"):
+        self._handle = _lib.sevenseg_open(path.encode())
+        if not self._handle:
+            err = ctypes.get_errno()
+            raise OSError(err, os.strerror(err), path)
+        self.digits = _lib.sevenseg_digits(self._handle)
+        self.lines = _lib.sevenseg_lines(self._handle)
+        self.segment_type = _lib.sevenseg_segment_type(self._handle)
+        self.interface = "ioctl" if _lib.sevenseg_interface(self._handle) == IF_IOCTL else "text"
+
+    def close(self):
+        if self._handle:
+            _lib.sevenseg_close(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def set(self, segments):
+        """
+        Aplica um quadro (lista de bitmaps, um por dígito; os que faltarem ficam apagados).
+        """
+        frame = (ctypes.c_uint64 * MAX_DIGITS)(*segments[:MAX_DIGITS])
+        _check(_lib.sevenseg_set(self._handle, frame, min(len(segments), MAX_DIGITS)))
+
+    def get(self) -> list:
+        """
+        Quadro atual, um bitmap por dígito.
+        """
+        frame = (ctypes.c_uint64 * MAX_DIGITS)()
+        _check(_lib.sevenseg_get(self._handle, frame, self.digits, None))
+        return list(frame[:self.digits])
+
+    def set_batch(self, frames):
+        """
+        Aplica vários quadros em sequência com uma única syscall por lote.
+        """
+        frames = list(frames)
+        data = (ctypes.c_uint64 * (len(frames) * self.digits))()
+        for i, segments in enumerate(frames):
+            for d, value in enumerate(segments[:self.digits]):
+                data[i * self.digits + d] = value
+        _check(_lib.sevenseg_set_batch(self._handle, data, len(frames), self.digits))
+
+    def wait_change(self, seq: int = 0):
+        """
+        Bloqueia até o quadro mudar (número de sequência diferente de 'seq').
+        Retorna (quadro, nova sequência). Só disponível na interface ioctl.
+        """
+        frame = (ctypes.c_uint64 * MAX_DIGITS)()
+        new_seq = ctypes.c_uint64()
+        _check(_lib.sevenseg_wait_change(self._handle, seq, frame, self.digits, ctypes.byref(new_seq)))
+        return list(frame[:self.digits]), new_seq.value
+
+    def text(self, text: str):
+        """
+        Mostra um texto curto, um caractere por dígito.
+        """
+        _check(_lib.sevenseg_set_text(self._handle, text.encode("ascii", "replace")))
+
+    def glyph(self, char: str) -> int:
+        return glyph(char, self.segment_type, self.lines)
@@ -2,166 +2,4722 @@
 #include <linux/module.h>         // Macros essenciais para criar módulos de Kernel
 #include <linux/kernel.h>         // Funções de log do Kernel, como printk()
 #include <linux/gpio.h>           // API para controle de GPIOs (pinos de entrada/saída)
+#include <linux/gpio/consumer.h>  // Descritores de GPIO, para escrever várias linhas de uma vez
+#include <linux/gpio/driver.h>    // Controlador de cada linha (gpiod_to_chip), para agrupar a varredura
+#include <linux/bitmap.h>         // Bitmap de valores das escritas em lote
 #include <linux/fs.h>             // Funções relacionadas ao sistema de arquivos
 #include <linux/uaccess.h>        // Funções para transferir dados entre o espaço do usuário e o Kernel
 #include <linux/cdev.h>           // Estruturas e funções para registrar dispositivos de caractere
 #include <linux/device.h>         // Estruturas para gerenciar dispositivos no Kernel
+#include <linux/uio.h>            // Iteradores de I/O (iov_iter) usados por read_iter/write_iter
+#include <linux/spinlock.h>       // Spinlocks para proteger o estado compartilhado do display
+#include <linux/slab.h>           // Alocação de memória no Kernel (kzalloc/kfree)
+#include <linux/hrtimer.h>        // Temporizadores de alta resolução, usados para aplicar quadros em um instante exato
+#include <linux/wait.h>           // Filas de espera para processos aguardando mudanças no display
+#include <linux/completion.h>     // Sinalização de término entre contextos (temporizador -> ioctl)
+#include <linux/io_uring.h>       // Comandos assíncronos enviados pelo io_uring (uring_cmd)
+#include <linux/splice.h>         // splice()/sendfile() diretamente para o dispositivo
+#include <linux/pipe_fs_i.h>      // Buffers (páginas) de pipes, consumidos pelo splice
+#include <linux/highmem.h>        // Mapeamento temporário de páginas (kmap_local_page)
+#include <linux/mutex.h>          // Mutexes para estados que podem dormir
+#include <linux/kernfs.h>         // Notificação de atributos sysfs para quem faz poll() neles
+#include <linux/map_to_7segment.h> // Tabela padrão do Kernel para converter caracteres ASCII em segmentos
+#include <linux/map_to_14segment.h> // Tabela equivalente para displays alfanuméricos de 14 segmentos
+#include <linux/leds.h>           // Classe LED do Kernel, para usar os gatilhos (heartbeat, timer, netdev...) nos segmentos
+#include <linux/workqueue.h>      // Trabalhos adiados (delayed_work), executados em contexto de processo
+#include <linux/thermal.h>        // Leitura de temperatura das zonas térmicas
+#include <linux/sched/loadavg.h>  // Carga média do sistema (avenrun)
+#include <linux/cpumask.h>        // Número de CPUs ativas, para converter a carga em porcentagem
+#include <linux/timekeeping.h>    // Relógio de parede (hora atual)
+#include <linux/eventfd.h>        // Contador alimentado por eventfd
+#include <linux/poll.h>           // Registro na fila de espera do eventfd (poll_table)
+#include <linux/file.h>           // fput()
+#include <linux/atomic.h>         // Valor do contador (atomic64_t)
+#include <linux/kfifo.h>          // Fila de relatórios de apresentação dos quadros agendados
+#include <linux/debugfs.h>        // Estatísticas de consumo (despertares e tempo na varredura)
+#include <linux/seq_file.h>       // Arquivos de texto do debugfs
+#include <linux/async.h>          // Registro em segundo plano (async_probe)
+#include <linux/configfs.h>       // Criação do display em tempo de execução (/sys/kernel/config/sevenseg)
+#include <linux/kthread.h>        // Thread do auto-benchmark e da varredura do charlieplexing
+#include <linux/vmalloc.h>        // Amostras de latência do auto-benchmark
+#include <linux/sort.h>           // Ordenação das amostras para os percentis
+#include <linux/sched.h>          // PID de quem escreveu cada quadro (histórico)
+#include <linux/version.h>        // LINUX_VERSION_CODE, para as APIs que mudaram entre versões do Kernel
+#include <linux/idr.h>            // Minors dos displays (carga e configfs)
+#include <linux/kref.h>           // Tempo de vida de cada display
+#include <net/genetlink.h>        // Família generic netlink: quadros publicados em multicast
+
+#include "sevenseg.h"             // Interface (ioctl/io_uring) compartilhada com o espaço do usuário
+#ifdef SEVENSEG_LINEDISP
+#include "line-display.h"         // Biblioteca line-display do auxdisplay (atributo 'message' e rolagem padrão), detectada pelo Makefile
+#endif
 
 #define DEVICE_NAME "sevenseg"    // Nome do dispositivo, aparecerá em /dev/sevenseg
 #define CLASS_NAME "sevenseg"     // Nome da classe de dispositivos, serve para agrupar dispositivos similares
 
-MODULE_LICENSE("GPL");            // Define a licença do módulo como GNU Public License - licença para código aberto sobre a qual podemos distribuir nosso código, permitindo cópia e alteração
-MODULE_AUTHOR("Lucas Barboza");
-MODULE_DESCRIPTION("Driver para controlar um display de 7 segmentos");
-MODULE_VERSION("1.0");
+MODULE_LICENSE("GPL");            // Define a licença do módulo como GNU Public License - licença para código aberto sobre a qual podemos distribuir nosso código, permitindo cópia e alteração
+MODULE_AUTHOR("Lucas Barboza");
+MODULE_DESCRIPTION("Driver para controlar um display de 7 segmentos");
+MODULE_VERSION("1.0");
+
+/**
+ * Estruturas de dados utilizadas pelo Kernel para criar
+ * um character device (chardev). O major e a classe são do módulo; cada
+ * display tem o seu minor, o seu cdev e o seu device (struct sevenseg_dev)
+ */
+#define SEVENSEG_MAX_DEVICES 128                    // Minors reservados: o display da carga e as instâncias do configfs
+static int major_number;                            // Número major do dispositivo (ID utilizado pelo sistema)
+static struct class* seven_segment_class = NULL;    // Estrutura que representa a classe do dispositivo
+static DEFINE_IDR(sevenseg_minors);                 // minor -> display; NULL enquanto o display não está registrado
+static DEFINE_MUTEX(sevenseg_minors_lock);          // Protege sevenseg_minors e a busca feita no open()
+static struct workqueue_struct *sevenseg_wq;        // Desligamentos adiados, esperados no rmmod
+static struct sevenseg_dev *primary_dev;            // Display de minor 0, alvo de sevenseg_counter_add()
+static DEFINE_SPINLOCK(primary_lock);               // Protege primary_dev (sevenseg_counter_add() vem de qualquer contexto)
+
+/**
+ * Definição dos pinos GPIO conectados ao display de 7 segmentos.
+ * Estes pinos GPIO foram selecionados aleatoriamente, lembre-se
+ * que temos um barramento de 40 pinos configuráveis à nossa disposição
+ */
+#define PIN_A 17
+#define PIN_B 18
+#define PIN_C 27
+#define PIN_D 22
+#define PIN_E 23
+#define PIN_F 24
+#define PIN_G 25
+
+/**
+ * Definição do tamanho máximo da nossa string binária de um dígito: um
+ * caractere por linha de segmento (até SEVENSEG_MAX_LINES) + o separador
+ * (espaço ou o terminador de string '\0'). O tamanho real de cada dígito vem
+ * do número de pinos configurado
+ */
+#define MAX_BUF_SIZE (SEVENSEG_MAX_LINES + 1)
+
+/**
+ * Em displays com vários dígitos, uma linha traz um grupo de segmentos por
+ * dígito, separados por espaço ("1110111 0110000"). Uma linha completa cabe em
+ * SEVENSEG_MAX_DIGITS grupos de MAX_BUF_SIZE caracteres (o último espaço vira o '\0')
+ */
+#define MAX_LINE_SIZE (SEVENSEG_MAX_DIGITS * MAX_BUF_SIZE)
+
+/**
+ * Aqui vamos criar um vetor com os números dos pinos selecionados
+ * para automatizar a manipulação. Por padrão são os 7 pinos acima, mas o
+ * parâmetro 'pins' aceita até SEVENSEG_MAX_LINES linhas por dígito: o ponto
+ * decimal (DP), displays alfanuméricos de 14 e 16 segmentos ou uma coluna de
+ * uma pequena matriz de pontos (cada linha da matriz vira um "dígito" com
+ * digit_pins). O bit i de cada dígito é sempre a linha pins[i]. Estes
+ * parâmetros configuram o display criado na carga e são o ponto de partida de
+ * cada instância criada pelo configfs
+ *
+ * Exemplo: sudo insmod sevenseg.ko pins=17,18,27,22,23,24,25,4   (7 segmentos + DP)
+ */
+static unsigned int param_pins[SEVENSEG_MAX_LINES] = {PIN_A, PIN_B, PIN_C, PIN_D, PIN_E, PIN_F, PIN_G};
+static int param_number_of_pins = 7;
+module_param_array_named(pins, param_pins, uint, &param_number_of_pins, 0444);
+MODULE_PARM_DESC(pins, "GPIOs das linhas de segmento de cada digito, na ordem dos bits (padrao: 17,18,27,22,23,24,25)");
+
+/**
+ * Tipo de dígito, usado apenas para desenhar caracteres (atributo 'text',
+ * fontes de dados e contador): 7, 14 ou 16 segmentos. Se houver uma linha a
+ * mais que o número de segmentos, ela é o ponto decimal
+ */
+static unsigned int param_segment_type = 7;
+module_param_named(segment_type, param_segment_type, uint, 0444);
+MODULE_PARM_DESC(segment_type, "Segmentos de cada digito para desenhar texto: 7, 14 ou 16");
+
+/**
+ * Displays com vários dígitos compartilham as linhas de segmento e cada dígito
+ * tem um pino de seleção (o catodo comum, normalmente através de um transistor).
+ * Como só um dígito pode ficar aceso por vez, um temporizador faz a varredura
+ * (multiplexação) rápido o suficiente para o olho enxergar todos acesos.
+ * Sem pinos de seleção temos o display original de um dígito, ligado direto
+ * aos pinos e sem nenhum temporizador
+ *
+ * Exemplo: sudo insmod sevenseg.ko digit_pins=5,6,13,19
+ */
+static unsigned int param_digit_pins[SEVENSEG_MAX_DIGITS];
+static int param_number_of_digit_pins;
+module_param_array_named(digit_pins, param_digit_pins, uint, &param_number_of_digit_pins, 0444);
+MODULE_PARM_DESC(digit_pins, "GPIOs de selecao de cada digito (display multiplexado)");
+
+static unsigned int param_refresh_hz = 100;
+module_param_named(refresh_hz, param_refresh_hz, uint, 0444);
+MODULE_PARM_DESC(refresh_hz, "Varreduras completas do display multiplexado por segundo");
+
+/**
+ * Charlieplexing: em vez de um pino por segmento mais um por dígito, N pinos
+ * acendem até N*(N-1) LEDs. Cada par ordenado de pinos (ânodo, catodo) tem um
+ * LED; cada pino fica em nível alto, baixo ou como entrada (alta impedância).
+ * A varredura acende uma "linha" por vez: o ânodo em nível alto, os catodos
+ * dos LEDs acesos em nível baixo e os demais pinos soltos. Os segmentos são
+ * numerados em sequência (dígito 0: LEDs 0 a 6, dígito 1: 7 a 13...) e o LED k
+ * fica no ânodo k / (N-1). Não pode ser usado junto com digit_pins
+ *
+ * Exemplo: sudo insmod sevenseg.ko charlie_pins=5,6,13,19,26,16  (6 pinos, 30 LEDs, 4 dígitos)
+ */
+#define CHARLIE_MAX_PINS 16
+static unsigned int param_charlie_pins[CHARLIE_MAX_PINS];
+static int param_number_of_charlie_pins;
+module_param_array_named(charlie_pins, param_charlie_pins, uint, &param_number_of_charlie_pins, 0444);
+MODULE_PARM_DESC(charlie_pins, "GPIOs do display em charlieplexing (no lugar dos pinos de segmento e de digito)");
+
+/**
+ * Framebuffer: cópia em memória ("sombra") do estado atual do display, com um
+ * bitmap de segmentos por dígito (o bit i representa o segmento ligado ao pino
+ * gpio_pins[i]). Assim não precisamos consultar os pinos a cada leitura, e toda
+ * escrita passa por um único caminho (apply_frame) protegido por um spinlock,
+ * que nunca dorme. Cada quadro aplicado recebe um número de sequência e o instante
+ * em que chegou ao display, usados por quem espera mudanças
+ *
+ * Buffer triplo entre quem escreve quadros e a varredura. O framebuffer acima
+ * é o estado lógico (escritores, frame_lock); os pinos mostram sempre um dos
+ * três buffers abaixo:
+ *
+ *   tb_back    - sendo preenchido pelo escritor (frame_lock)
+ *   tb_pending - último quadro completo publicado, ainda não pego pela varredura
+ *   tb_front   - quadro nos pinos (pins_lock)
+ *
+ * O escritor publica um quadro inteiro trocando os índices back e pending com
+ * um xchg() atômico; a varredura só troca pending e front quando volta ao
+ * primeiro dígito. Assim um quadro nunca aparece pela metade (parte do quadro
+ * antigo, parte do novo), e nenhum lado espera o outro: escritores e varredura
+ * não compartilham lock
+ */
+#define TB_INDEX 0x3
+#define TB_FRESH 0x4                        // Em tb_pending: há um quadro novo ainda não mostrado
+struct scan_buffer {
+    u64 segments[SEVENSEG_MAX_DIGITS];
+    int nr_rows;                            // Charlieplexing: número de linhas com algum LED aceso
+    u8 row_anode[CHARLIE_MAX_PINS];         // ... na ordem de varredura, calculada pelo escritor
+    u16 row_sinks[CHARLIE_MAX_PINS];        // Catodos (pinos em nível baixo) de cada uma delas
+};
+
+/**
+ * Economia de energia. Quando o conteúdo não precisa de varredura (display
+ * apagado, brilho zero, um único dígito ou uma única linha de charlieplexing),
+ * a varredura trava os pinos no estado atual e para o temporizador; o PWM
+ * também para com o display apagado. Quem publicar o próximo quadro acorda os
+ * temporizadores parados (bits de idle_timers). Quando precisam rodar, os
+ * temporizadores aceitam uma folga (timer_slack_pct do período) para o Kernel
+ * agrupar o despertar deles com outros e a CPU dormir mais
+ */
+static unsigned int timer_slack_pct = 10;
+module_param(timer_slack_pct, uint, 0644);
+MODULE_PARM_DESC(timer_slack_pct, "Folga permitida aos temporizadores de varredura, em % do periodo");
+
+#define CONTENT_SLACK_NS NSEC_PER_MSEC      // Folga dos temporizadores de conteúdo (rolagem, animação, contador)
+
+#define IDLE_REFRESH 0
+#define IDLE_PWM 1
+
+/**
+ * Estatísticas, em /sys/kernel/debug/sevenseg/stats. Os contadores da
+ * varredura são protegidos por pins_lock (e, nos displays de um grupo da
+ * varredura compartilhada, também pelo lock do grupo, que é quem os atualiza)
+ */
+struct sevenseg_stats {
+    atomic64_t wakeups;                     // Disparos de todos os temporizadores e trabalhos do driver
+    atomic64_t idle_entries;                // Vezes em que a varredura ou o PWM pararam por conteúdo estático
+    u64 refresh_calls;
+    u64 refresh_ns;                         // Tempo total dentro do tratador da varredura
+    u64 refresh_max_ns;
+    u64 since_ns;                           // Início da contagem (carga do módulo ou último reset)
+    u64 acquire_count;                      // Vezes em que os GPIOs foram pedidos (protegidos por pins_mutex)
+    u64 acquire_last_ns;                    // Tempo gasto no último pedido
+    u64 acquire_max_ns;
+};
+
+#define HISTORY_RECORDS 1024                // Quadros guardados no histórico (ver history_record())
+#define TEXT_MAX 128                        // Tamanho máximo do texto (atributo 'text')
+
+enum source_kind {                          // Fonte de dados do Kernel mostrada no display (ver source_work_fn())
+    SOURCE_NONE,
+    SOURCE_CLOCK,
+    SOURCE_THERMAL,
+    SOURCE_LOADAVG,
+};
+
+struct bench_result {                       // Resultado do auto-benchmark (ver bench_thread())
+    u64 frames;
+    u64 elapsed_ns;
+    u64 cpu_ns;                             // Tempo de CPU da própria thread
+    u32 rate_hz;                            // 0 = o mais rápido possível
+    u32 p50_ns, p90_ns, p99_ns, p999_ns, max_ns;
+    bool pins_held;
+};
+
+struct sevenseg_led {                       // Um segmento registrado como LED (ver register_segment_leds())
+    struct led_classdev cdev;
+    struct sevenseg_dev *sd;
+    int segment;
+};
+
+/**
+ * Estado de um display. O display criado na carga do módulo (a partir dos
+ * parâmetros) e cada instância criada pelo configfs têm o seu: pinos,
+ * framebuffer, temporizadores, motores de conteúdo, histórico, chardev, sysfs,
+ * LEDs e debugfs. Nada é compartilhado entre dois displays além das linhas de
+ * GPIO que o gpiolib já recusa pedir duas vezes
+ */
+struct sevenseg_dev {
+    struct kref ref;                        // Quem cria o display, cada arquivo aberto e o desligamento adiado
+    int minor;                              // /dev/sevenseg (minor 0) ou /dev/sevenseg<minor>
+    char name[16];                          // Nome do device, dos LEDs e do diretório no debugfs
+    struct config_item item;                // Instância do configfs (não usada pelo display da carga)
+
+    // Configuração dos pinos (parâmetros do módulo ou atributos do configfs)
+    unsigned int gpio_pins[SEVENSEG_MAX_LINES];
+    int number_of_pins;
+    unsigned int segment_type;
+    unsigned int digit_pins[SEVENSEG_MAX_DIGITS];
+    int number_of_digit_pins;
+    unsigned int refresh_hz;
+    unsigned int charlie_pins[CHARLIE_MAX_PINS];
+    int number_of_charlie_pins;
+    int number_of_digits;                   // Calculado em configure_layout() a partir de digit_pins (ou charlie_pins)
+
+    // Framebuffer e quem espera por mudanças (frame_lock)
+    spinlock_t frame_lock;
+    u64 framebuffer[SEVENSEG_MAX_DIGITS];
+    u64 frame_seq;
+    u64 frame_latch_ns;                     // Instante em que o último quadro foi publicado (ver apply_frame())
+    wait_queue_head_t frame_wq;             // Processos bloqueados em SEVENSEG_IOC_WAIT_CHANGE
+    struct list_head change_waiters;        // Comandos io_uring aguardando a próxima mudança
+    struct list_head timed_waiters;         // Comandos io_uring SET_FRAME_AT com o temporizador armado
+    struct kernfs_node *frame_kn;           // Atributo sysfs 'frame', notificado a cada quadro aplicado
+
+    // Buffer triplo (ver tb_publish()) e os pinos (pins_lock)
+    struct scan_buffer scan_buffers[3];
+    unsigned int tb_back;
+    unsigned int tb_pending;
+    unsigned int tb_front;
+    spinlock_t pins_lock;                   // Serializa o acesso aos pinos: varredura, PWM e o display sem multiplexação
+    bool pins_held;                         // Os GPIOs estão conosco; sem eles ninguém escreve nos pinos
+    int scan_digit;                         // Dígito aceso no momento pela varredura (sempre 0 sem multiplexação)
+    bool pwm_phase_on;                      // Fase atual do PWM: pinos mostrando o quadro ou apagados
+    s8 charlie_state[CHARLIE_MAX_PINS];     // Estado de cada pino do charlieplexing (ver charlie_drive())
+    struct task_struct *scan_task;          // Varredura do charlieplexing (ver charlie_thread()); só muda com pins_lock
+    struct gpio_desc *segment_descs[SEVENSEG_MAX_LINES];   // Preenchido em request_pins()
+    struct gpio_desc *digit_descs[SEVENSEG_MAX_DIGITS];
+    bool lines_sleep;                       // Alguma linha de segmento ou de dígito pode dormir (request_pins())
+    unsigned int brightness;
+    struct scan_group *scan_group;          // Grupo da varredura compartilhada (ver scan_member_step()); só muda com pins_lock
+    struct list_head scan_node;             // Em scan_group->members. Os campos scan_* abaixo são protegidos pelo lock do grupo
+    u64 scan_deadline_ns;                   // Próximo evento da varredura (0: agora, U64_MAX: parada)
+    u64 scan_step_start_ns;                 // Início do passo atual
+    u64 scan_slack_ns;                      // Folga aceita para o próximo evento
+    bool scan_dark;                         // Falta apagar os segmentos no meio do passo (brilho intermediário)
+    bool scan_parked;                       // Parada por conteúdo estático: ao acordar, volta ao primeiro dígito
+    bool scan_due;                          // Avançou no último disparo do grupo (estatísticas)
+    struct hrtimer pwm_timer;
+    unsigned long idle_timers;              // Temporizadores parados por conteúdo estático (IDLE_REFRESH, IDLE_PWM)
+    struct sevenseg_stats stats;
+
+    // Histórico dos quadros aplicados (frame_lock) e sua publicação no generic netlink
+    struct sevenseg_history_record *history;
+    u64 history_reserved;                   // Registros já começados
+    u64 history_head;                       // Registros completos
+    u64 genl_next;                          // Próximo registro do histórico a publicar
+    struct work_struct genl_work;
+
+    // Motores de conteúdo
+    struct mutex text_lock;                 // Serializa quem troca o texto
+    spinlock_t scroll_lock;                 // Protege o estado da rolagem, lido pelo temporizador
+    char scroll_text[TEXT_MAX];
+    int scroll_len;
+    int scroll_pos;                         // Índice do caractere mostrado no primeiro dígito (pode ser negativo)
+    unsigned int scroll_speed_ms;
+    unsigned int scroll_pause_ms;
+    bool scroll_loop;
+    bool scroll_right;                      // false: o texto anda para a esquerda (entra pela direita)
+    struct hrtimer scroll_timer;
+    spinlock_t anim_lock;                   // Protege o programa em execução, lido pelo temporizador
+    struct sevenseg_anim_step *anim_steps;
+    u32 anim_count;
+    u32 anim_repeat;                        // 0 = para sempre
+    u32 anim_index;                         // Próximo passo a tocar
+    u32 anim_pass;                          // Repetições já completadas
+    struct hrtimer anim_timer;
+    spinlock_t replay_lock;                 // Protege a reprodução em andamento, lida pelo temporizador
+    struct sevenseg_history_record *replay_records;
+    u32 replay_count;
+    u32 replay_index;                       // Próximo registro a aplicar
+    ktime_t replay_base;                    // Instante em que o primeiro registro foi aplicado
+    struct hrtimer replay_timer;
+    struct mutex source_lock;               // Protege a configuração da fonte
+    enum source_kind source_kind;
+    char source_tz_name[THERMAL_NAME_LENGTH];   // Só o nome: a zona é procurada a cada leitura, pois o módulo dela pode sair
+    unsigned int source_interval_ms;
+    struct delayed_work source_work;
+    struct mutex counter_lock;              // Protege o registro do eventfd
+    bool counter_active;
+    atomic64_t counter_value;
+    unsigned long counter_redraw;           // Bit 0: redesenho já agendado
+    struct eventfd_ctx *counter_ctx;
+    wait_queue_entry_t counter_wait;
+    poll_table counter_pt;                  // Só para achar o display em counter_queue_proc()
+    struct hrtimer counter_timer;
+#ifdef SEVENSEG_LINEDISP
+    struct linedisp linedisp;
+    char linedisp_chars[SEVENSEG_MAX_DIGITS];
+    bool linedisp_ready;                    // Ignora a mensagem de boas-vindas mostrada durante o registro
+#endif
+
+    // Posse dos pinos (pins_mutex) e ligar/desligar o display (instance_mutex)
+    struct mutex pins_mutex;                // Serializa pedir e devolver os pinos
+    int pin_users;                          // Arquivos abertos do device
+    struct delayed_work pins_release_work;
+    bool down_pending;                      // Instância do configfs removida com o arquivo aberto (pins_mutex e instance_mutex)
+    struct work_struct instance_down_work;  // Desliga o display depois do último close() nesse caso
+    struct mutex instance_mutex;            // Serializa ligar e desligar o display (carga, configfs e rmmod)
+    bool display_enabled;                   // Pinos configurados e o device registrado (ou a caminho, com async_probe)
+    bool registered;                        // Chardev, device, debugfs e LEDs criados (pode ser false com async_probe)
+
+    // Registro: chardev, sysfs, LEDs e debugfs
+    struct cdev *cdev;
+    struct device *device;
+    struct dev_ext_attribute seg_attrs[SEVENSEG_MAX_LINES];
+    char seg_attr_names[SEVENSEG_MAX_LINES][8];
+    struct attribute *seg_attr_list[SEVENSEG_MAX_LINES + 1];
+    struct attribute_group segment_group;
+    const struct attribute_group *groups[3];
+    struct sevenseg_led segment_leds[SEVENSEG_MAX_LINES];
+    char segment_led_names[SEVENSEG_MAX_LINES][32];
+    int number_of_leds;                     // LEDs registrados com sucesso (para a limpeza)
+    struct dentry *debugfs_dir;
+    struct mutex bench_lock;                // Protege a thread e o resultado do benchmark
+    struct task_struct *bench_task;
+    bool bench_done;                        // A thread terminou a medida e publicou o resultado
+    struct bench_result bench_result;
+    u32 *bench_samples;
+    u64 bench_duration_ns;
+    u32 bench_rate_hz;
+};
+
+static inline bool multiplexed(struct sevenseg_dev *sd) {
+    return sd->number_of_digit_pins > 0;
+}
+
+static inline bool charlieplexed(struct sevenseg_dev *sd) {
+    return sd->number_of_charlie_pins > 0;
+}
+
+/**
+ * Displays que precisam de varredura (nada fica aceso sem o temporizador)
+ */
+static inline bool scanned(struct sevenseg_dev *sd) {
+    return multiplexed(sd) || charlieplexed(sd);
+}
+
+static inline void stat_wakeup(struct sevenseg_dev *sd) {
+    atomic64_inc(&sd->stats.wakeups);
+}
+
+/**
+ * Contabiliza uma execução da varredura iniciada em 'start'. Chamada com pins_lock travado
+ */
+static void stat_refresh(struct sevenseg_dev *sd, u64 start) {
+    u64 ns = ktime_get_ns() - start;
+
+    sd->stats.refresh_calls++;
+    sd->stats.refresh_ns += ns;
+    sd->stats.refresh_max_ns = max(sd->stats.refresh_max_ns, ns);
+}
+
+/**
+ * Controle de brilho por PWM em software. Com brilho máximo (ou zero) os
+ * pinos ficam simplesmente travados no quadro atual (ou apagados) e nenhum
+ * temporizador roda; nos valores intermediários um hrtimer alterna entre o
+ * quadro e o display apagado, com o tempo ligado proporcional ao brilho
+ */
+#define BRIGHTNESS_MAX 100
+#define PWM_PERIOD_NS (5 * NSEC_PER_MSEC)   // 200 Hz, acima do que o olho percebe como cintilação
+
+/**
+ * Dados que guardamos dentro do próprio comando io_uring (área 'pdu'),
+ * evitando uma alocação para cada comando pendente
+ */
+struct sevenseg_cmd_pdu {
+    struct list_head node;              // Entrada na lista change_waiters
+    void __user *arg;                   // Onde a resposta será escrita no espaço do usuário
+    union {                             // A área tem só 32 bytes: cada comando usa um dos dois
+        struct sevenseg_timed_req *req; // Requisição agendada (SET_FRAME_AT) ou o erro do cancelamento
+        fl_owner_t owner;               // Tabela de descritores de quem submeteu (WAIT_CHANGE na lista)
+    };
+};
+
+static inline struct sevenseg_cmd_pdu *cmd_pdu(struct io_uring_cmd *ioucmd) {
+    BUILD_BUG_ON(sizeof(struct sevenseg_cmd_pdu) > sizeof(ioucmd->pdu));
+    return (struct sevenseg_cmd_pdu *)ioucmd->pdu;
+}
+
+static inline struct io_uring_cmd *pdu_cmd(struct sevenseg_cmd_pdu *pdu) {
+    return (struct io_uring_cmd *)((u8 *)pdu - offsetof(struct io_uring_cmd, pdu));
+}
+
+static void uring_cmd_complete(struct io_uring_cmd *ioucmd);
+
+
+/**
+ * Máscara com todos os segmentos de um dígito ligados
+ */
+static inline u64 all_segments(struct sevenseg_dev *sd) {
+    return GENMASK_ULL(sd->number_of_pins - 1, 0);
+}
+
+/**
+ * Copia o estado atual do display para uma estrutura de resposta.
+ * Deve ser chamada com frame_lock travado
+ */
+static void fill_report(struct sevenseg_dev *sd, struct sevenseg_frame *report) {
+    memset(report->segments, 0, sizeof(report->segments));
+    memcpy(report->segments, sd->framebuffer, sd->number_of_digits * sizeof(sd->framebuffer[0]));
+    report->seq = sd->frame_seq;
+    report->latch_ns = sd->frame_latch_ns;
+}
+
+/**
+ * Escritas em lote: quando todas as linhas de segmento mudam (a cada passo da
+ * varredura e do PWM), uma única chamada gpiod_set_raw_array_value() cobre
+ * todas elas. O gpiolib agrupa as linhas por controlador e faz um set_multiple
+ * por chip, em vez de um acesso ao controlador por linha. Escritas parciais
+ * (um segmento pelo sysfs ou pelos LEDs) continuam linha a linha
+ */
+static bool batch_writes = true;
+module_param(batch_writes, bool, 0644);
+MODULE_PARM_DESC(batch_writes, "Escreve todas as linhas de segmento com uma chamada por controlador de GPIO");
+
+
+/**
+ * Escreve nas linhas de segmento marcadas em 'mask' os valores de 'value'.
+ * Deve ser chamada com pins_lock travado
+ */
+static void write_pins(struct sevenseg_dev *sd, u64 value, u64 mask) {
+    if (mask == all_segments(sd) && READ_ONCE(batch_writes)) {
+        DECLARE_BITMAP(values, SEVENSEG_MAX_LINES);
+
+        bitmap_from_u64(values, value);
+        gpiod_set_raw_array_value(sd->number_of_pins, sd->segment_descs, NULL, values);
+        return;
+    }
+    for (int i = 0; i < sd->number_of_pins; i++) {
+        if (mask & BIT_ULL(i)) {
+            gpio_set_value(sd->gpio_pins[i], !!(value & BIT_ULL(i)));
+        }
+    }
+}
+
+/**
+ * Varredura compartilhada. Com vários displays, um temporizador por instância
+ * multiplicaria os despertares e os acessos aos controladores. Os displays
+ * multiplexados, e também os diretos cujas linhas podem dormir (expansores
+ * I2C/SPI, gpio-sim), entram no grupo do controlador de GPIO das suas linhas de
+ * segmento: um único hrtimer por controlador (ou, se alguma linha pode dormir,
+ * uma única thread do Kernel) avança juntos todos os membros que vencem dentro
+ * da folga e escreve as linhas de todos eles com três chamadas
+ * gpiod_set_raw_array_value() por disparo (dígitos que apagam, segmentos,
+ * dígitos que acendem), cada uma um set_multiple por controlador. O brilho
+ * vira o ciclo de trabalho de cada passo, sem pwm_timer. O charlieplexing troca
+ * direções em vez de níveis e continua na sua própria thread (charlie_thread())
+ */
+static bool shared_scan = true;
+module_param(shared_scan, bool, 0644);
+MODULE_PARM_DESC(shared_scan, "Agrupa a varredura de todos os displays de um mesmo controlador de GPIO (0: um grupo por display)");
+
+struct scan_group {
+    struct list_head node;                  // Em scan_groups
+    struct gpio_chip *chip;                 // Controlador das linhas de segmento dos membros
+    const void *owner;                      // Com shared_scan=0, o display dono do grupo
+    bool can_sleep;                         // Escritas pela thread (_cansleep), não pelo hrtimer
+    int users;                              // Protegido por scan_groups_lock
+    struct mutex write_mutex;               // Grupos que dormem: a thread escreve fora de 'lock', com ele travado
+    spinlock_t lock;                        // Membros, o estado scan_* deles, os vetores abaixo e o temporizador
+    struct list_head members;
+    struct hrtimer timer;
+    struct task_struct *task;
+    bool kicked;                            // Algum membro pediu um disparo imediato (thread)
+    u64 slack_ns;                           // Folga do próximo disparo (a do membro que vence primeiro)
+    unsigned int lines;                     // Linhas dos membros (segmentos + um dígito cada)
+    unsigned int capacity;                  // Tamanho dos vetores
+    struct gpio_desc **off, **seg, **on;    // Escritas de um disparo: dígitos que apagam, segmentos, dígitos que acendem
+    unsigned long *zeros, *seg_values, *ones;
+    unsigned int n_off, n_seg, n_on;
+    u64 ticks;                              // Disparos desde since_ns
+    u64 since_ns;
+};
+
+static LIST_HEAD(scan_groups);
+static DEFINE_MUTEX(scan_groups_lock);
+
+/**
+ * Pede um disparo imediato do grupo. Chamada com g->lock travado: o callback
+ * do hrtimer só mexe na expiração com ele, então não há corrida com o hrtimer_start()
+ */
+static void scan_group_kick(struct scan_group *g) {
+    if (g->can_sleep) {
+        g->kicked = true;
+        wake_up_process(g->task);
+    } else {
+        hrtimer_start(&g->timer, 0, HRTIMER_MODE_ABS);
+    }
+}
+
+/**
+ * Pede ao grupo que mostre o estado atual do display no próximo disparo (já).
+ * Chamada com pins_lock travado e o display em um grupo
+ */
+static void scan_kick(struct sevenseg_dev *sd) {
+    struct scan_group *g = sd->scan_group;
+    unsigned long flags;
+
+    spin_lock_irqsave(&g->lock, flags);
+    sd->scan_deadline_ns = 0;
+    scan_group_kick(g);
+    spin_unlock_irqrestore(&g->lock, flags);
+}
+
+/**
+ * Quantos pinos mudam de estado ao passar da linha (a, sinks_a) para a linha
+ * (b, sinks_b). Cada mudança é uma troca de direção (ou de nível) de um GPIO
+ */
+static unsigned int charlie_cost(int a, u16 sinks_a, int b, u16 sinks_b) {
+    return hweight16((BIT(a) ^ BIT(b)) | (sinks_a ^ sinks_b));
+}
+
+/**
+ * Monta o plano de varredura de um quadro em charlieplexing: agrupa os LEDs
+ * acesos por ânodo, pula as linhas apagadas e ordena as restantes de forma
+ * gulosa (sempre a linha mais parecida com a anterior), para trocar o mínimo
+ * de direções de GPIO a cada varredura. Com no máximo 16 linhas, é barato o
+ * suficiente para rodar a cada quadro publicado
+ */
+static void charlie_plan(struct sevenseg_dev *sd, struct scan_buffer *buf) {
+    u16 sinks[CHARLIE_MAX_PINS] = {0};
+    int n = sd->number_of_charlie_pins;
+    u32 pending = 0;
+    int last = -1;
+
+    for (int d = 0; d < sd->number_of_digits; d++) {
+        for (int i = 0; i < sd->number_of_pins; i++) {
+            int led = d * sd->number_of_pins + i, anode = led / (n - 1), cathode = led % (n - 1);
+
+            if (!(buf->segments[d] & BIT_ULL(i)) || anode >= n) {
+                continue;
+            }
+            if (cathode >= anode) {
+                cathode++;                      // O pino do próprio ânodo não é catodo de ninguém
+            }
+            sinks[anode] |= BIT(cathode);
+            pending |= BIT(anode);
+        }
+    }
+
+    buf->nr_rows = 0;
+    while (pending) {
+        unsigned int best_cost = UINT_MAX;
+        int best = 0;
+
+        for (int r = 0; r < n; r++) {
+            unsigned int cost;
+
+            if (!(pending & BIT(r))) {
+                continue;
+            }
+            cost = last < 0 ? 0 : charlie_cost(last, sinks[last], r, sinks[r]);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = r;
+            }
+        }
+        buf->row_anode[buf->nr_rows] = best;
+        buf->row_sinks[buf->nr_rows] = sinks[best];
+        buf->nr_rows++;
+        pending &= ~BIT(best);
+        last = best;
+    }
+}
+
+static u64 refresh_slack_ns(struct sevenseg_dev *sd) {
+    int steps = charlieplexed(sd) ? sd->number_of_charlie_pins : sd->number_of_digits;
+
+    return div_u64(NSEC_PER_SEC, sd->refresh_hz * steps) * timer_slack_pct / 100;
+}
+
+/**
+ * Retoma a varredura parada: o grupo do display ou, no charlieplexing, a thread.
+ * Sob pins_lock o grupo e a thread não somem enquanto os acordamos (ver drop_pins())
+ */
+static void refresh_wake(struct sevenseg_dev *sd) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    if (sd->scan_group) {
+        scan_kick(sd);
+    } else if (sd->scan_task) {
+        wake_up_process(sd->scan_task);
+    }
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+}
+
+/**
+ * Rearma os temporizadores que pararam por conteúdo estático. O xchg() de
+ * tb_publish() vem antes, então ou nós vemos o bit ou o temporizador vê o
+ * quadro novo (ver timer_go_idle())
+ */
+static void wake_idle_timers(struct sevenseg_dev *sd) {
+    if (!READ_ONCE(sd->idle_timers)) {
+        return;
+    }
+    if (test_and_clear_bit(IDLE_REFRESH, &sd->idle_timers)) {
+        refresh_wake(sd);
+    }
+    if (test_and_clear_bit(IDLE_PWM, &sd->idle_timers)) {
+        hrtimer_start(&sd->pwm_timer, 0, HRTIMER_MODE_REL);
+    }
+}
+
+/**
+ * Chamada por um temporizador que quer parar. Retorna false se um quadro novo
+ * chegou nesse meio tempo (e ninguém mais vai acordá-lo): ele deve continuar
+ */
+static bool timer_go_idle(struct sevenseg_dev *sd, int bit) {
+    set_bit(bit, &sd->idle_timers);
+    smp_mb__after_atomic();                 // Par do xchg() em tb_publish()
+    if ((READ_ONCE(sd->tb_pending) & TB_FRESH) && test_and_clear_bit(bit, &sd->idle_timers)) {
+        return false;
+    }
+    atomic64_inc(&sd->stats.idle_entries);
+    return true;
+}
+
+/**
+ * Publica o framebuffer como o próximo quadro completo. Chamada com frame_lock
+ * travado; o xchg() é uma barreira completa, então a varredura que pegar este
+ * buffer enxerga todo o conteúdo copiado antes dele
+ */
+static void tb_publish(struct sevenseg_dev *sd) {
+    memcpy(sd->scan_buffers[sd->tb_back].segments, sd->framebuffer, sizeof(sd->framebuffer));
+    if (charlieplexed(sd)) {
+        charlie_plan(sd, &sd->scan_buffers[sd->tb_back]);   // O plano da varredura vai junto com o quadro: o temporizador só o executa
+    }
+    sd->tb_back = xchg(&sd->tb_pending, sd->tb_back | TB_FRESH) & TB_INDEX;
+    wake_idle_timers(sd);
+}
+
+/**
+ * Passa o último quadro publicado (se houver um novo) para os pinos. Chamada
+ * com pins_lock travado (ou, nos displays em um grupo da varredura, com o lock
+ * do grupo), no início de uma varredura
+ */
+static void tb_latch(struct sevenseg_dev *sd) {
+    if (READ_ONCE(sd->tb_pending) & TB_FRESH) {
+        sd->tb_front = xchg(&sd->tb_pending, sd->tb_front) & TB_INDEX;
+    }
+}
+
+/**
+ * Segmentos do dígito aceso no momento. Chamada com pins_lock travado
+ */
+static inline u64 shown_segments(struct sevenseg_dev *sd) {
+    return sd->pwm_phase_on ? sd->scan_buffers[sd->tb_front].segments[sd->scan_digit] : 0;
+}
+
+/**
+ * Leva os pinos do charlieplexing ao estado pedido, mexendo apenas nos que
+ * mudam (charlie_state: -1 entrada, 0 baixo, 1 alto). Trocar a direção de um
+ * GPIO pode dormir, então só é chamada em contexto de processo, sem pins_lock:
+ * pela thread da varredura ou com ela parada
+ */
+static void charlie_drive(struct sevenseg_dev *sd, u16 high, u16 low) {
+    // Primeiro soltamos todo pino que vai mudar, para nenhum LED de fora piscar na transição...
+    for (int i = 0; i < sd->number_of_charlie_pins; i++) {
+        s8 want = (high & BIT(i)) ? 1 : (low & BIT(i)) ? 0 : -1;
+
+        if (sd->charlie_state[i] != want && sd->charlie_state[i] != -1) {
+            gpio_direction_input(sd->charlie_pins[i]);
+            sd->charlie_state[i] = -1;
+        }
+    }
+    // ...e só então ligamos a nova linha
+    for (int i = 0; i < sd->number_of_charlie_pins; i++) {
+        s8 want = (high & BIT(i)) ? 1 : (low & BIT(i)) ? 0 : -1;
+
+        if (sd->charlie_state[i] != want) {
+            gpio_direction_output(sd->charlie_pins[i], want);
+            sd->charlie_state[i] = want;
+        }
+    }
+}
+
+/**
+ * Acende a linha atual da varredura (ou solta todos os pinos na fase apagada
+ * do brilho). Mesmas regras de charlie_drive()
+ */
+static void charlie_show(struct sevenseg_dev *sd) {
+    const struct scan_buffer *buf = &sd->scan_buffers[sd->tb_front];
+
+    if (!sd->pwm_phase_on || sd->scan_digit >= buf->nr_rows) {
+        charlie_drive(sd, 0, 0);
+    } else {
+        charlie_drive(sd, BIT(buf->row_anode[sd->scan_digit]), buf->row_sinks[sd->scan_digit]);
+    }
+}
+
+/**
+ * Indica se o quadro nos pinos é todo apagado. Chamada com pins_lock travado
+ */
+static bool front_is_blank(struct sevenseg_dev *sd) {
+    const struct scan_buffer *buf = &sd->scan_buffers[sd->tb_front];
+
+    if (charlieplexed(sd)) {
+        return buf->nr_rows == 0;
+    }
+    for (int d = 0; d < sd->number_of_digits; d++) {
+        if (buf->segments[d]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Indica se o quadro nos pinos pode ficar travado sem varredura (com o mesmo
+ * brilho que teria com ela). Chamada com pins_lock travado, no início de uma varredura
+ */
+static bool front_is_static(struct sevenseg_dev *sd) {
+    if (sd->brightness == 0 || front_is_blank(sd)) {
+        return true;
+    }
+    if (charlieplexed(sd)) {
+        return sd->scan_buffers[sd->tb_front].nr_rows == 1;
+    }
+    return sd->number_of_digits == 1;
+}
+
+/**
+ * Coloca nos pinos o que deve estar aceso agora (nos displays com varredura em
+ * grupo ou no charlieplexing, acorda quem escreve neles). Chamada com pins_lock travado
+ */
+static void show_current(struct sevenseg_dev *sd) {
+    if (!sd->pins_held) {
+        return;
+    }
+    if (sd->scan_group) {
+        scan_kick(sd);
+    } else if (charlieplexed(sd)) {
+        if (sd->scan_task) {
+            wake_up_process(sd->scan_task);     // Os pinos do charlieplexing são da thread: ela mostra no próximo passo
+        }
+    } else {
+        write_pins(sd, shown_segments(sd), all_segments(sd));
+    }
+}
+
+/**
+ * Histórico dos últimos HISTORY_RECORDS quadros aplicados, para investigar o
+ * que o display mostrou (e repetir depois). Quem grava já está sob frame_lock,
+ * então há um único escritor por vez; os leitores não travam nada. O escritor
+ * reserva a posição (history_reserved) antes de sobrescrevê-la e a publica
+ * (history_head) depois: um leitor que copiou o registro 'i' e depois vê
+ * history_reserved - i > HISTORY_RECORDS sabe que a cópia pode estar misturada
+ */
+
+/**
+ * Grava o framebuffer atual no histórico. Chamada com frame_lock travado
+ */
+static void history_record(struct sevenseg_dev *sd) {
+    struct sevenseg_history_record *record = &sd->history[sd->history_head % HISTORY_RECORDS];
+
+    WRITE_ONCE(sd->history_reserved, sd->history_head + 1);
+    smp_wmb();                              // Par do smp_rmb() em history_fetch()
+    memset(record->segments, 0, sizeof(record->segments));
+    memcpy(record->segments, sd->framebuffer, sd->number_of_digits * sizeof(sd->framebuffer[0]));
+    record->seq = sd->frame_seq;
+    record->latch_ns = sd->frame_latch_ns;
+    // Temporizadores e interrupções não escrevem por processo algum, e em kworkers (motor 'source')
+    // ou kthreads (benchmark) o current é uma thread do próprio Kernel. As threads do io_uring não
+    // são kthreads e ficam com o processo que submeteu o comando
+    record->pid = in_task() && !(current->flags & PF_KTHREAD) ? task_tgid_nr(current) : 0;
+    record->reserved = 0;
+    smp_store_release(&sd->history_head, sd->history_head + 1);
+}
+
+/**
+ * Copia o registro 'index' (que já deve estar completo). Retorna false se ele
+ * foi sobrescrito durante a cópia
+ */
+static bool history_fetch(struct sevenseg_dev *sd, u64 index, struct sevenseg_history_record *record) {
+    memcpy(record, &sd->history[index % HISTORY_RECORDS], sizeof(*record));
+    smp_rmb();
+    return READ_ONCE(sd->history_reserved) - index <= HISTORY_RECORDS;
+}
+
+/**
+ * Publicação dos quadros na família generic netlink "sevenseg" (ver sevenseg.h).
+ * apply_frame() pode rodar em interrupção, onde não se envia netlink, então ele
+ * só agenda genl_work; o trabalho publica todos os registros do histórico
+ * desde a última vez, um por quadro. Sem ouvintes nada é agendado
+ */
+static struct genl_family sevenseg_genl_family;
+static bool genl_registered;
+
+/**
+ * Agenda a publicação do quadro que acabou de ser gravado. Chamada com frame_lock travado
+ */
+static void genl_frame_applied(struct sevenseg_dev *sd) {
+    if (READ_ONCE(genl_registered) && genl_has_listeners(&sevenseg_genl_family, &init_net, 0)) {
+        schedule_work(&sd->genl_work);
+    } else {
+        sd->genl_next = sd->history_head;           // Quem começar a ouvir depois não recebe quadros antigos
+    }
+}
+
+/**
+ * Aplica um novo quadro ("frame") ao display: 'frame' traz um bitmap por dígito.
+ * Apenas os segmentos marcados em 'mask' são alterados (NULL altera todos), os
+ * demais permanecem como estavam. Se 'report' não for NULL, recebe o estado exato
+ * que foi aplicado. Pode ser chamada de qualquer contexto, inclusive de temporizadores
+ */
+static void apply_frame(struct sevenseg_dev *sd, const u64 *frame, const u64 *mask, struct sevenseg_frame *report) {
+    struct sevenseg_cmd_pdu *pdu, *tmp;
+    unsigned long flags;
+    LIST_HEAD(woken);
+
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    for (int d = 0; d < sd->number_of_digits; d++) {
+        u64 m = mask ? mask[d] : all_segments(sd);
+
+        sd->framebuffer[d] = (sd->framebuffer[d] & ~m) | (frame[d] & m);
+    }
+    tb_publish(sd);
+    if (!scanned(sd)) {                   // Sem varredura, o quadro vai direto para os pinos
+        spin_lock(&sd->pins_lock);
+        if (!sd->scan_group) {            // Linhas que dormem: a thread do grupo, acordada por tb_publish(), é quem escreve
+            tb_latch(sd);
+            if (sd->pins_held) {
+                write_pins(sd, shown_segments(sd), mask ? mask[0] : all_segments(sd));  // Na fase apagada do PWM o quadro
+            }                                                                   // só vai para os pinos no próximo ciclo
+        }
+        spin_unlock(&sd->pins_lock);
+    }
+    // Instante de publicação. Sem varredura é também o instante em que o quadro chegou aos pinos; com
+    // varredura (multiplexação, charlieplexing) ele aparece no início da próxima varredura, até um período
+    // completo depois, e com lazy_pins e os pinos devolvidos só no próximo open()
+    sd->frame_latch_ns = ktime_get_ns();
+    sd->frame_seq++;
+    history_record(sd);
+    genl_frame_applied(sd);
+    if (report) {
+        fill_report(sd, report);
+    }
+    list_splice_init(&sd->change_waiters, &woken);
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+
+    // Acordamos quem estava esperando por uma mudança (ioctl, io_uring e poll() no sysfs)
+    wake_up_interruptible_all(&sd->frame_wq);
+    if (sd->frame_kn) {
+        sysfs_notify_dirent(sd->frame_kn);
+    }
+    list_for_each_entry_safe(pdu, tmp, &woken, node) {
+        list_del(&pdu->node);
+        pdu->req = NULL;                // Sai de 'owner': uring_cmd_complete() responde com o quadro atual
+        io_uring_cmd_complete_in_task(pdu_cmd(pdu), uring_cmd_complete);
+    }
+}
+
+/**
+ * Copia o framebuffer atual (para leitura fora do spinlock)
+ */
+static void snapshot_frame(struct sevenseg_dev *sd, u64 *frame) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    memcpy(frame, sd->framebuffer, sizeof(sd->framebuffer));
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+}
+
+/**
+ * Converte uma mensagem binária ('0' e '1') em um quadro. A mensagem termina
+ * no primeiro '\0' ou '\n', um espaço passa para o próximo dígito e somente os
+ * segmentos presentes nela são marcados na máscara - "111" altera apenas os
+ * segmentos A, B e C do primeiro dígito, como antes. 'frame' e 'mask' devem
+ * vir zerados; retorna false se a mensagem não tinha nenhum segmento
+ */
+static bool parse_message(struct sevenseg_dev *sd, const char *message, size_t len, u64 *frame, u64 *mask) {
+    int digit = 0, segment = 0;
+    bool any = false;
+
+    for (size_t i = 0; i < len && message[i] != '\0' && message[i] != '\n'; i++) {
+        if (message[i] == ' ') {
+            if (++digit >= sd->number_of_digits) {
+                break;
+            }
+            segment = 0;
+            continue;
+        }
+        if (segment >= sd->number_of_pins) {
+            continue;                           // Caracteres além do número de segmentos são ignorados
+        }
+        mask[digit] |= BIT_ULL(segment);
+        if (message[i] == '1') {                // Se o caractere lido for '1' (char, e nao int), o segmento será ligado
+            frame[digit] |= BIT_ULL(segment);
+        }
+        segment++;
+        any = true;
+    }
+    return any;
+}
+
+static void apply_message(struct sevenseg_dev *sd, const char *message, size_t len) {
+    u64 frame[SEVENSEG_MAX_DIGITS] = {0}, mask[SEVENSEG_MAX_DIGITS] = {0};
+
+    if (parse_message(sd, message, len, frame, mask)) {
+        apply_frame(sd, frame, mask, NULL);
+    }
+}
+
+/**
+ * Monta a string binária ('0' e '1') de um quadro, com os dígitos separados por
+ * espaço e sem o terminador. Retorna o número de caracteres escritos (no máximo
+ * MAX_LINE_SIZE - 1)
+ */
+static int frame_to_string(struct sevenseg_dev *sd, const u64 *frame, char *buf) {
+    int len = 0;
+
+    for (int d = 0; d < sd->number_of_digits; d++) {
+        if (d > 0) {
+            buf[len++] = ' ';
+        }
+        for (int i = 0; i < sd->number_of_pins; i++) {
+            buf[len++] = (frame[d] & BIT_ULL(i)) ? '1' : '0';
+        }
+    }
+    return len;
+}
+
+/**
+ * Acrescenta ao disparo do grupo as linhas de segmento do display com os valores de 'value'
+ */
+static void scan_add_segments(struct scan_group *g, struct sevenseg_dev *sd, u64 value) {
+    for (int i = 0; i < sd->number_of_pins; i++) {
+        g->seg[g->n_seg] = sd->segment_descs[i];
+        __assign_bit(g->n_seg, g->seg_values, value & BIT_ULL(i));
+        g->n_seg++;
+    }
+}
+
+/**
+ * Um evento da varredura de um membro. No início de um passo apaga o dígito
+ * atual, coloca nas linhas de segmento o conteúdo do próximo e o acende (sem
+ * multiplexação, só reescreve os segmentos); um quadro novo só é pego ao
+ * voltar ao primeiro dígito, então cada varredura mostra um único quadro. Com
+ * brilho intermediário, um segundo evento apaga os segmentos depois da parte
+ * acesa do passo. Chamada com g->lock travado (sem pins_lock: enquanto o
+ * display está no grupo, só o grupo mexe no estado da varredura e nos pinos)
+ */
+static void scan_member_step(struct scan_group *g, struct sevenseg_dev *sd, u64 now) {
+    unsigned int brightness = READ_ONCE(sd->brightness);
+    u64 step_ns = multiplexed(sd) ? div_u64(NSEC_PER_SEC, sd->refresh_hz * sd->number_of_digits) : PWM_PERIOD_NS;
+    u64 start = sd->scan_deadline_ns + step_ns > now ? sd->scan_deadline_ns : now;  // Atrasos de um passo inteiro não são compensados
+    bool idle = false, dimmed;
+
+    sd->scan_slack_ns = div_u64(step_ns * timer_slack_pct, 100);
+    if (sd->scan_dark) {
+        sd->scan_dark = false;
+        scan_add_segments(g, sd, 0);
+        sd->scan_deadline_ns = sd->scan_step_start_ns + step_ns;
+        return;
+    }
+
+    if (sd->scan_parked) {
+        sd->scan_parked = false;
+        sd->scan_digit = sd->number_of_digits - 1;  // A primeira execução já volta ao dígito 0 e pega o quadro novo
+    }
+    if (multiplexed(sd)) {
+        g->off[g->n_off++] = sd->digit_descs[sd->scan_digit];
+    }
+    sd->scan_digit = (sd->scan_digit + 1) % sd->number_of_digits;
+    if (sd->scan_digit == 0) {
+        tb_latch(sd);
+        idle = front_is_static(sd);
+    }
+    dimmed = brightness > 0 && brightness < BRIGHTNESS_MAX && !front_is_blank(sd);
+    scan_add_segments(g, sd, brightness > 0 ? sd->scan_buffers[sd->tb_front].segments[sd->scan_digit] : 0);
+    if (multiplexed(sd)) {
+        g->on[g->n_on++] = sd->digit_descs[sd->scan_digit];   // Parados, o dígito 0 fica aceso (se o quadro não for apagado, é o único dígito)
+    }
+
+    sd->scan_step_start_ns = start;
+    sd->scan_dark = dimmed;
+    if (dimmed) {
+        sd->scan_deadline_ns = start + div_u64(step_ns * brightness, BRIGHTNESS_MAX);
+    } else if (idle && timer_go_idle(sd, IDLE_REFRESH)) {
+        sd->scan_parked = true;
+        sd->scan_deadline_ns = U64_MAX;         // Até refresh_wake() ou show_current()
+    } else {
+        sd->scan_deadline_ns = start + step_ns;
+    }
+}
+
+/**
+ * Escreve um dos três lotes de um disparo: uma chamada para todas as linhas
+ * (um set_multiple por controlador) ou, com batch_writes=0, uma por linha
+ */
+static void scan_write(struct scan_group *g, unsigned int n, struct gpio_desc **descs, unsigned long *values) {
+    if (n == 0) {
+        return;
+    }
+    if (READ_ONCE(batch_writes)) {
+        if (g->can_sleep) {
+            gpiod_set_raw_array_value_cansleep(n, descs, NULL, values);
+        } else {
+            gpiod_set_raw_array_value(n, descs, NULL, values);
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        if (g->can_sleep) {
+            gpiod_set_raw_value_cansleep(descs[i], test_bit(i, values));
+        } else {
+            gpiod_set_raw_value(descs[i], test_bit(i, values));
+        }
+    }
+}
+
+/**
+ * Um disparo do grupo: avança todos os membros que vencem até agora (mais a
+ * folga de cada um), escreve as linhas deles e reparte o tempo gasto entre
+ * eles nas estatísticas. Retorna o instante do próximo disparo (U64_MAX:
+ * nenhum membro precisa). Nos grupos com hrtimer a escrita acontece com g->lock
+ * travado; nos que dormem, fora dele, com write_mutex travado
+ */
+static u64 scan_group_run(struct scan_group *g) {
+    u64 start = ktime_get_ns(), next = U64_MAX, share;
+    struct sevenseg_dev *sd;
+    unsigned int due = 0;
+    unsigned long flags;
+
+    if (g->can_sleep) {
+        mutex_lock(&g->write_mutex);
+    }
+    spin_lock_irqsave(&g->lock, flags);
+    g->kicked = false;
+    g->ticks++;
+    g->n_off = g->n_seg = g->n_on = 0;
+    list_for_each_entry(sd, &g->members, scan_node) {
+        if (sd->scan_deadline_ns <= start + sd->scan_slack_ns) {
+            scan_member_step(g, sd, start);
+            sd->scan_due = true;
+            due++;
+        }
+        if (sd->scan_deadline_ns < next) {
+            next = sd->scan_deadline_ns;
+            g->slack_ns = sd->scan_slack_ns;
+        }
+    }
+    if (g->can_sleep) {
+        spin_unlock_irqrestore(&g->lock, flags);
+    }
+
+    scan_write(g, g->n_off, g->off, g->zeros);
+    scan_write(g, g->n_seg, g->seg, g->seg_values);
+    scan_write(g, g->n_on, g->on, g->ones);
+
+    if (g->can_sleep) {
+        spin_lock_irqsave(&g->lock, flags);
+    }
+    share = div_u64(ktime_get_ns() - start, max(due, 1U));
+    list_for_each_entry(sd, &g->members, scan_node) {
+        if (sd->scan_due) {
+            sd->scan_due = false;
+            stat_wakeup(sd);
+            sd->stats.refresh_calls++;
+            sd->stats.refresh_ns += share;
+            sd->stats.refresh_max_ns = max(sd->stats.refresh_max_ns, share);
+        }
+    }
+    // Um hrtimer_start() de scan_group_kick() pode ter enfileirado o temporizador: então a expiração é a dele
+    if (!g->can_sleep && next != U64_MAX && !hrtimer_is_queued(&g->timer)) {
+        hrtimer_set_expires_range_ns(&g->timer, ns_to_ktime(next), g->slack_ns);
+    }
+    spin_unlock_irqrestore(&g->lock, flags);
+    if (g->can_sleep) {
+        mutex_unlock(&g->write_mutex);
+    }
+    return next;
+}
+
+/**
+ * Temporizador de um grupo cujas linhas não dormem
+ */
+static enum hrtimer_restart scan_group_tick(struct hrtimer *timer) {
+    struct scan_group *g = container_of(timer, struct scan_group, timer);
+
+    return scan_group_run(g) == U64_MAX ? HRTIMER_NORESTART : HRTIMER_RESTART;
+}
+
+/**
+ * Thread de um grupo cujas linhas podem dormir: mesmos disparos do hrtimer,
+ * dormindo até o próximo ou até scan_group_kick()
+ */
+static int scan_group_thread(void *data) {
+    struct scan_group *g = data;
+
+    while (!kthread_should_stop()) {
+        u64 next = scan_group_run(g);
+        ktime_t expires = ns_to_ktime(next);
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (kthread_should_stop() || READ_ONCE(g->kicked)) {
+            __set_current_state(TASK_RUNNING);
+            continue;
+        }
+        if (next == U64_MAX) {
+            schedule();
+        } else {
+            schedule_hrtimeout_range(&expires, READ_ONCE(g->slack_ns), HRTIMER_MODE_ABS);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Espera até 'deadline_ns' (CLOCK_MONOTONIC) ou até alguém acordar a thread
+ */
+static void charlie_sleep_until(struct sevenseg_dev *sd, u64 deadline_ns) {
+    ktime_t expires = ns_to_ktime(deadline_ns);
+
+    set_current_state(TASK_INTERRUPTIBLE);
+    if (kthread_should_stop()) {
+        __set_current_state(TASK_RUNNING);
+        return;
+    }
+    schedule_hrtimeout_range(&expires, refresh_slack_ns(sd), HRTIMER_MODE_ABS);
+}
+
+/**
+ * Varredura do charlieplexing. Cada linha troca a direção de alguns GPIOs, e
+ * gpio_direction_input()/gpio_direction_output() podem dormir mesmo em
+ * controladores cujas escritas não dormem (o gpiolib passa pelo pinctrl), então
+ * a varredura roda em uma thread do Kernel (tempo real, prioridade baixa) e não
+ * em um temporizador. Enquanto os pinos estão conosco só ela mexe neles, sem
+ * pins_lock em volta dos GPIOs. O período é dividido apenas entre as linhas
+ * acesas, então o ciclo completo continua durando 1 / refresh_hz. O brilho vira
+ * o ciclo de trabalho de cada linha (acesa no começo do passo, solta no resto),
+ * no lugar do pwm_timer
+ */
+static int charlie_thread(void *data) {
+    struct sevenseg_dev *sd = data;
+    u64 next = ktime_get_ns();
+
+    while (!kthread_should_stop()) {
+        u64 start = ktime_get_ns(), step_ns, on_ns;
+        unsigned long flags;
+        bool idle = false, dimmed;
+        int rows;
+
+        stat_wakeup(sd);
+        spin_lock_irqsave(&sd->pins_lock, flags);
+        if (++sd->scan_digit >= sd->scan_buffers[sd->tb_front].nr_rows) {
+            sd->scan_digit = 0;
+            tb_latch(sd);
+            idle = front_is_static(sd);         // Uma única linha acesa fica travada nos pinos
+        }
+        rows = max(sd->scan_buffers[sd->tb_front].nr_rows, 1);
+        step_ns = div_u64(NSEC_PER_SEC, sd->refresh_hz * rows);
+        on_ns = div_u64(step_ns * sd->brightness, BRIGHTNESS_MAX);
+        dimmed = sd->brightness > 0 && sd->brightness < BRIGHTNESS_MAX && !front_is_blank(sd);
+        idle = idle && !dimmed;                 // Com brilho intermediário até uma linha só precisa do ciclo de trabalho
+        sd->pwm_phase_on = sd->brightness > 0;
+        spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+        charlie_show(sd);
+        spin_lock_irqsave(&sd->pins_lock, flags);
+        stat_refresh(sd, start);
+        spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+        if (idle && timer_go_idle(sd, IDLE_REFRESH)) {
+            // Parada até o próximo quadro (ou brilho): refresh_wake() limpa o bit antes de nos acordar
+            set_current_state(TASK_INTERRUPTIBLE);
+            if (test_bit(IDLE_REFRESH, &sd->idle_timers) && !kthread_should_stop()) {
+                schedule();
+            }
+            __set_current_state(TASK_RUNNING);
+            next = ktime_get_ns();
+            continue;
+        }
+
+        next = max(next + step_ns, start);      // Se atrasamos, seguimos a partir de agora em vez de correr atrás
+        if (dimmed) {
+            charlie_sleep_until(sd, next - step_ns + on_ns);
+            spin_lock_irqsave(&sd->pins_lock, flags);
+            sd->pwm_phase_on = false;
+            spin_unlock_irqrestore(&sd->pins_lock, flags);
+            charlie_show(sd);
+        }
+        charlie_sleep_until(sd, next);
+    }
+    return 0;
+}
+
+/**
+ * Cria a thread da varredura do charlieplexing. Chamada com pins_mutex travado,
+ * depois de pedir os pinos
+ */
+static int charlie_start(struct sevenseg_dev *sd) {
+    struct task_struct *task = kthread_create(charlie_thread, sd, "%s-scan", sd->name);
+    unsigned long flags;
+
+    if (IS_ERR(task)) {
+        return PTR_ERR(task);
+    }
+    sched_set_fifo_low(task);                   // Acima das tarefas comuns, para o display não piscar com a CPU ocupada
+    clear_bit(IDLE_REFRESH, &sd->idle_timers);
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    sd->scan_task = task;
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+    wake_up_process(task);
+    return 0;
+}
+
+/**
+ * Para a thread da varredura, se estiver rodando. Chamada com pins_mutex travado
+ */
+static void charlie_stop(struct sevenseg_dev *sd) {
+    struct task_struct *task;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    task = sd->scan_task;
+    sd->scan_task = NULL;                       // Ninguém mais a acorda: refresh_wake() e show_current() olham sob pins_lock
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+    if (task) {
+        kthread_stop(task);
+    }
+}
+
+/**
+ * Temporizador do PWM: alterna entre a fase ligada e a apagada. Se o brilho
+ * voltou ao máximo (ou a zero) enquanto ele estava armado, trava os pinos
+ * no estado final e para de rodar
+ */
+static enum hrtimer_restart pwm_tick(struct hrtimer *timer) {
+    struct sevenseg_dev *sd = container_of(timer, struct sevenseg_dev, pwm_timer);
+    unsigned long flags;
+    u64 on_ns;
+
+    stat_wakeup(sd);
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    if (!sd->pins_held || sd->scan_group) {     // Quem pedir os pinos de novo reinicia o PWM; nos grupos o brilho é da varredura
+        spin_unlock_irqrestore(&sd->pins_lock, flags);
+        return HRTIMER_NORESTART;
+    }
+    if (sd->brightness == 0 || sd->brightness == BRIGHTNESS_MAX) {
+        sd->pwm_phase_on = sd->brightness > 0;
+        show_current(sd);
+        spin_unlock_irqrestore(&sd->pins_lock, flags);
+        return HRTIMER_NORESTART;
+    }
+    if (front_is_blank(sd)) {                 // Nada aceso: não há o que modular até o próximo quadro
+        sd->pwm_phase_on = true;
+        show_current(sd);
+        spin_unlock_irqrestore(&sd->pins_lock, flags);
+        if (timer_go_idle(sd, IDLE_PWM)) {
+            return HRTIMER_NORESTART;
+        }
+        hrtimer_forward_now(timer, ns_to_ktime(PWM_PERIOD_NS));
+        return HRTIMER_RESTART;
+    }
+    sd->pwm_phase_on = !sd->pwm_phase_on;
+    show_current(sd);
+    on_ns = div_u64(PWM_PERIOD_NS * sd->brightness, BRIGHTNESS_MAX);
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+    hrtimer_forward_now(timer, ns_to_ktime(sd->pwm_phase_on ? on_ns : PWM_PERIOD_NS - on_ns));
+    return HRTIMER_RESTART;
+}
+
+static void set_brightness(struct sevenseg_dev *sd, unsigned int value) {
+    unsigned long flags;
+    bool pwm;
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    sd->brightness = value;
+    if (value == 0 || value == BRIGHTNESS_MAX) {
+        sd->pwm_phase_on = value > 0;
+        show_current(sd);
+    } else if (sd->scan_group && sd->pins_held) {
+        scan_kick(sd);
+    }
+    pwm = !charlieplexed(sd) && !sd->scan_group;    // No charlieplexing e nos grupos o brilho é da varredura
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+    if (value == 0 || value == BRIGHTNESS_MAX) {
+        hrtimer_cancel(&sd->pwm_timer);     // Pinos travados: nenhum temporizador precisa continuar rodando
+    } else if (pwm && !hrtimer_active(&sd->pwm_timer)) {
+        clear_bit(IDLE_PWM, &sd->idle_timers);
+        hrtimer_start(&sd->pwm_timer, 0, HRTIMER_MODE_REL);
+    }
+    if (test_and_clear_bit(IDLE_REFRESH, &sd->idle_timers)) {
+        refresh_wake(sd);                   // A varredura pode ter parado com brilho zero
+    }
+}
+
+/**
+ * Motor de rolagem de texto. Um texto maior que o display é escrito uma única
+ * vez (atributo 'text') e um hrtimer desloca uma "janela" do tamanho do display
+ * sobre ele, um caractere por passo. O texto entra por um lado e sai pelo
+ * outro; no fim pode pausar e recomeçar (scroll_loop) ou parar no último passo
+ */
+static SEG7_DEFAULT_MAP(map_seg7);          // Tabela padrão do Kernel: caractere ASCII -> segmentos
+static SEG14_DEFAULT_MAP(map_seg14);        // Idem, para 14 segmentos
+
+/**
+ * Displays de 16 segmentos são os de 14 com os segmentos de cima (A) e de
+ * baixo (D) divididos em duas metades. Ordem dos bits: A1 A2 B C D1 D2 E F
+ * G1 G2 H I J K L M (e DP). Os desenhos vêm da tabela de 14 segmentos do
+ * Kernel, acendendo as duas metades de A e D
+ */
+static const u32 seg14_to_seg16[] = {
+    [BIT_SEG14_A] = BIT(0) | BIT(1),
+    [BIT_SEG14_B] = BIT(2),
+    [BIT_SEG14_C] = BIT(3),
+    [BIT_SEG14_D] = BIT(4) | BIT(5),
+    [BIT_SEG14_E] = BIT(6),
+    [BIT_SEG14_F] = BIT(7),
+    [BIT_SEG14_G1] = BIT(8),
+    [BIT_SEG14_G2] = BIT(9),
+    [BIT_SEG14_H] = BIT(10),
+    [BIT_SEG14_I] = BIT(11),
+    [BIT_SEG14_J] = BIT(12),
+    [BIT_SEG14_K] = BIT(13),
+    [BIT_SEG14_L] = BIT(14),
+    [BIT_SEG14_M] = BIT(15),
+};
+
+/**
+ * Converte um caractere em segmentos (caracteres fora da tabela ficam
+ * apagados). O '.' acende o ponto decimal, quando existe a linha dele
+ */
+static u64 char_to_segments(struct sevenseg_dev *sd, char c) {
+    int segments;
+    u64 result = 0;
+
+    if (c == '.' && sd->number_of_pins > sd->segment_type) {
+        return BIT_ULL(sd->segment_type);
+    }
+    switch (sd->segment_type) {
+    case 14:
+        segments = map_to_seg14(&map_seg14, c);
+        break;
+    case 16:
+        segments = map_to_seg14(&map_seg14, c);
+        for (int i = 0; i < ARRAY_SIZE(seg14_to_seg16) && segments > 0; i++) {
+            if (segments & BIT(i)) {
+                result |= seg14_to_seg16[i];
+            }
+        }
+        return result;
+    default:
+        segments = map_to_seg7(&map_seg7, c);
+        break;
+    }
+    return segments < 0 ? 0 : segments;
+}
+
+/**
+ * Monta o quadro da janela do texto que começa no caractere 'start'.
+ * Posições fora do texto ficam apagadas
+ */
+static void render_text(struct sevenseg_dev *sd, const char *text, int len, int start, u64 *frame) {
+    for (int d = 0; d < sd->number_of_digits; d++) {
+        int i = start + d;
+
+        frame[d] = (i >= 0 && i < len) ? char_to_segments(sd, text[i]) : 0;
+    }
+}
+
+/**
+ * Primeira e última posições da janela: na rolagem para a esquerda o primeiro
+ * caractere entra pelo último dígito e o último sai pelo primeiro dígito
+ */
+static int scroll_first(struct sevenseg_dev *sd) {
+    return sd->scroll_right ? sd->scroll_len - 1 : 1 - sd->number_of_digits;
+}
+
+static bool scroll_at_end(struct sevenseg_dev *sd) {
+    return sd->scroll_right ? sd->scroll_pos <= 1 - sd->number_of_digits : sd->scroll_pos >= sd->scroll_len - 1;
+}
+
+static enum hrtimer_restart scroll_tick(struct hrtimer *timer) {
+    struct sevenseg_dev *sd = container_of(timer, struct sevenseg_dev, scroll_timer);
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    unsigned int delay_ms;
+    unsigned long flags;
+    bool again = true;
+
+    stat_wakeup(sd);
+    spin_lock_irqsave(&sd->scroll_lock, flags);
+    render_text(sd, sd->scroll_text, sd->scroll_len, sd->scroll_pos, frame);
+    delay_ms = sd->scroll_speed_ms;
+    if (scroll_at_end(sd)) {
+        delay_ms += sd->scroll_pause_ms;        // Pausa no fim do texto antes de recomeçar
+        again = sd->scroll_loop;
+        sd->scroll_pos = scroll_first(sd);
+    } else {
+        sd->scroll_pos += sd->scroll_right ? -1 : 1;
+    }
+    spin_unlock_irqrestore(&sd->scroll_lock, flags);
+
+    apply_frame(sd, frame, NULL, NULL);
+    if (!again) {
+        return HRTIMER_NORESTART;
+    }
+    hrtimer_forward_now(timer, ms_to_ktime(delay_ms));
+    return HRTIMER_RESTART;
+}
+
+/**
+ * Mostra um texto: se couber no display vira um quadro estático, senão
+ * começa a rolar. Chamada com text_lock travado e os motores parados
+ */
+static void show_text(struct sevenseg_dev *sd, const char *text) {
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    unsigned long flags;
+    int len;
+
+    spin_lock_irqsave(&sd->scroll_lock, flags);
+    strscpy(sd->scroll_text, text, sizeof(sd->scroll_text));
+    sd->scroll_len = len = strlen(sd->scroll_text);
+    sd->scroll_pos = scroll_first(sd);
+    spin_unlock_irqrestore(&sd->scroll_lock, flags);
+
+    if (len <= sd->number_of_digits) {
+        render_text(sd, text, len, 0, frame);
+        apply_frame(sd, frame, NULL, NULL);
+    } else {
+        hrtimer_start_range_ns(&sd->scroll_timer, 0, CONTENT_SLACK_NS, HRTIMER_MODE_REL);
+    }
+}
+
+/**
+ * Animações carregadas pelo usuário (SEVENSEG_IOC_ANIM_LOAD) e tocadas por um
+ * hrtimer: cada passo fica no display pela sua duração e a sequência se repete
+ * sozinha, então o processo que a carregou pode até terminar
+ */
+
+static enum hrtimer_restart anim_tick(struct hrtimer *timer) {
+    struct sevenseg_dev *sd = container_of(timer, struct sevenseg_dev, anim_timer);
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    unsigned int delay_ms;
+    unsigned long flags;
+    bool again = true;
+
+    stat_wakeup(sd);
+    spin_lock_irqsave(&sd->anim_lock, flags);
+    memcpy(frame, sd->anim_steps[sd->anim_index].segments, sizeof(frame));
+    delay_ms = max(sd->anim_steps[sd->anim_index].duration_ms, 1U);
+    if (++sd->anim_index == sd->anim_count) {
+        sd->anim_index = 0;
+        if (sd->anim_repeat && ++sd->anim_pass >= sd->anim_repeat) {
+            again = false;                  // Última repetição: o último quadro fica no display
+        }
+    }
+    spin_unlock_irqrestore(&sd->anim_lock, flags);
+
+    apply_frame(sd, frame, NULL, NULL);
+    if (!again) {
+        return HRTIMER_NORESTART;
+    }
+    hrtimer_forward_now(timer, ms_to_ktime(delay_ms));
+    return HRTIMER_RESTART;
+}
+
+/**
+ * Para a animação atual e libera o programa. Com 'steps' diferente de NULL,
+ * instala e começa a tocar um novo programa no lugar do anterior
+ */
+static void anim_replace(struct sevenseg_dev *sd, struct sevenseg_anim_step *steps, u32 count, u32 repeat) {
+    struct sevenseg_anim_step *old;
+    unsigned long flags;
+
+    hrtimer_cancel(&sd->anim_timer);
+    spin_lock_irqsave(&sd->anim_lock, flags);
+    old = sd->anim_steps;
+    sd->anim_steps = steps;
+    sd->anim_count = count;
+    sd->anim_repeat = repeat;
+    sd->anim_index = 0;
+    sd->anim_pass = 0;
+    spin_unlock_irqrestore(&sd->anim_lock, flags);
+    kvfree(old);
+
+    if (steps) {
+        hrtimer_start_range_ns(&sd->anim_timer, 0, CONTENT_SLACK_NS, HRTIMER_MODE_REL);
+    }
+}
+
+/**
+ * Reprodução de um histórico gravado: cada registro é aplicado no mesmo
+ * intervalo (em relação ao primeiro) em que foi gravado. Os instantes são
+ * absolutos, então um atraso em um quadro não se acumula nos seguintes
+ */
+
+static enum hrtimer_restart replay_tick(struct hrtimer *timer) {
+    struct sevenseg_dev *sd = container_of(timer, struct sevenseg_dev, replay_timer);
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    unsigned long flags;
+    u64 offset_ns = 0;
+    bool again;
+
+    stat_wakeup(sd);
+    spin_lock_irqsave(&sd->replay_lock, flags);
+    memcpy(frame, sd->replay_records[sd->replay_index].segments, sizeof(frame));
+    again = ++sd->replay_index < sd->replay_count;
+    if (again && sd->replay_records[sd->replay_index].latch_ns > sd->replay_records[0].latch_ns) {
+        offset_ns = sd->replay_records[sd->replay_index].latch_ns - sd->replay_records[0].latch_ns;
+    }
+    spin_unlock_irqrestore(&sd->replay_lock, flags);
+
+    apply_frame(sd, frame, NULL, NULL);
+    if (!again) {
+        return HRTIMER_NORESTART;
+    }
+    hrtimer_set_expires(timer, ktime_add_ns(sd->replay_base, offset_ns));
+    return HRTIMER_RESTART;
+}
+
+/**
+ * Para a reprodução atual e libera os registros. Com 'records' diferente de
+ * NULL, começa a reproduzi-los no lugar
+ */
+static void replay_replace(struct sevenseg_dev *sd, struct sevenseg_history_record *records, u32 count) {
+    struct sevenseg_history_record *old;
+    unsigned long flags;
+
+    hrtimer_cancel(&sd->replay_timer);
+    spin_lock_irqsave(&sd->replay_lock, flags);
+    old = sd->replay_records;
+    sd->replay_records = records;
+    sd->replay_count = count;
+    sd->replay_index = 0;
+    sd->replay_base = ktime_get();
+    spin_unlock_irqrestore(&sd->replay_lock, flags);
+    kvfree(old);
+
+    if (records) {
+        hrtimer_start(&sd->replay_timer, sd->replay_base, HRTIMER_MODE_ABS);
+    }
+}
+
+/**
+ * Fontes de dados do próprio Kernel: o driver lê periodicamente um valor e o
+ * mostra no display, sem nenhum processo no espaço do usuário. Usamos um
+ * delayed_work (e não um hrtimer) porque ler uma zona térmica pode dormir.
+ * Ele é "deferrable": com a CPU ociosa, a leitura espera o próximo despertar
+ * por outro motivo em vez de acordá-la só para isso
+ *
+ *   clock          - hora HHMM em UTC deslocada de tz_offset_min (o Kernel não conhece o fuso local)
+ *   thermal:<zona> - temperatura em graus Celsius (ex.: thermal:cpu-thermal)
+ *   loadavg        - carga média de 1 minuto em % da capacidade das CPUs
+ */
+static int tz_offset_min;
+module_param(tz_offset_min, int, 0644);
+MODULE_PARM_DESC(tz_offset_min, "Fuso horario da fonte 'clock', em minutos a leste de UTC (0 = UTC)");
+
+/**
+ * Mostra um número alinhado à direita; se não couber, ficam os dígitos menos
+ * significativos (como em um hodômetro)
+ */
+static void show_number(struct sevenseg_dev *sd, const char *text) {
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    int len = strlen(text);
+
+    render_text(sd, text, len, len - sd->number_of_digits, frame);
+    apply_frame(sd, frame, NULL, NULL);
+}
+
+static void source_work_fn(struct work_struct *work) {
+    struct sevenseg_dev *sd = container_of(to_delayed_work(work), struct sevenseg_dev, source_work);
+    struct thermal_zone_device *tz;
+    unsigned int interval_ms;
+    char text[16] = "";
+    struct tm tm;
+    int temp;
+
+    stat_wakeup(sd);
+    mutex_lock(&sd->source_lock);
+    switch (sd->source_kind) {
+    case SOURCE_CLOCK:
+        time64_to_tm(ktime_get_real_seconds(), READ_ONCE(tz_offset_min) * 60, &tm);
+        snprintf(text, sizeof(text), "%02d%02d", tm.tm_hour, tm.tm_min);
+        break;
+    case SOURCE_THERMAL:
+        tz = thermal_zone_get_zone_by_name(sd->source_tz_name);
+        if (!IS_ERR(tz) && thermal_zone_get_temp(tz, &temp) == 0) {
+            snprintf(text, sizeof(text), "%d", temp / 1000);    // A zona informa a temperatura em miligraus
+        } else {
+            strscpy(text, "E", sizeof(text));                   // Leitura falhou: mostramos um 'E' de erro
+        }
+        break;
+    case SOURCE_LOADAVG:
+        snprintf(text, sizeof(text), "%lu", avenrun[0] * 100 / (FIXED_1 * num_online_cpus()));
+        break;
+    case SOURCE_NONE:
+        mutex_unlock(&sd->source_lock);
+        return;
+    }
+    interval_ms = sd->source_interval_ms;
+    mutex_unlock(&sd->source_lock);
+
+    show_number(sd, text);
+    schedule_delayed_work(&sd->source_work, msecs_to_jiffies(interval_ms));
+}
+
+/**
+ * Troca a fonte de dados. Chamada com os motores parados
+ */
+static int source_set(struct sevenseg_dev *sd, const char *spec) {
+    char name[THERMAL_NAME_LENGTH] = "";
+    struct thermal_zone_device *tz;
+    enum source_kind kind;
+
+    if (sysfs_streq(spec, "none")) {
+        kind = SOURCE_NONE;
+    } else if (sysfs_streq(spec, "clock")) {
+        kind = SOURCE_CLOCK;
+    } else if (sysfs_streq(spec, "loadavg")) {
+        kind = SOURCE_LOADAVG;
+    } else if (strncmp(spec, "thermal:", 8) == 0) {
+        strscpy(name, spec + 8, sizeof(name));
+        name[strcspn(name, "\n")] = '\0';
+        tz = thermal_zone_get_zone_by_name(name);  // Só valida o nome agora
+        if (IS_ERR(tz)) {
+            return PTR_ERR(tz);
+        }
+        kind = SOURCE_THERMAL;
+    } else {
+        return -EINVAL;
+    }
+
+    mutex_lock(&sd->source_lock);
+    sd->source_kind = kind;
+    strscpy(sd->source_tz_name, name, sizeof(sd->source_tz_name));
+    mutex_unlock(&sd->source_lock);
+    if (kind != SOURCE_NONE) {
+        schedule_delayed_work(&sd->source_work, 0);
+    }
+    return 0;
+}
+
+/**
+ * Modo contador: o display mostra um contador mantido no Kernel, incrementado
+ * a cada sinal de um eventfd registrado pelo usuário (ou por outro módulo,
+ * através de sevenseg_counter_add()). Nenhum write() nem formatação de texto
+ * por evento: rajadas de eventos são agrupadas em no máximo um redesenho por
+ * período de varredura (1 / refresh_hz)
+ *
+ * Assim como o irqfd do KVM, entramos direto na fila de espera do eventfd:
+ * a função de despertar roda no contexto de quem sinalizou, consome o valor
+ * do eventfd e apenas agenda o redesenho
+ */
+
+static enum hrtimer_restart counter_tick(struct hrtimer *timer) {
+    struct sevenseg_dev *sd = container_of(timer, struct sevenseg_dev, counter_timer);
+    char text[24];
+
+    stat_wakeup(sd);
+    clear_bit(0, &sd->counter_redraw);          // Antes de ler o valor: o que chegar depois agenda outro redesenho
+    if (READ_ONCE(sd->counter_active)) {
+        snprintf(text, sizeof(text), "%llu", (unsigned long long)atomic64_read(&sd->counter_value));
+        show_number(sd, text);
+    }
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * Soma 'n' ao contador exibido. Pode ser chamada de qualquer contexto,
+ * inclusive de interrupções; não faz nada se o modo contador não estiver ativo
+ */
+static void counter_add(struct sevenseg_dev *sd, u64 n) {
+    if (!READ_ONCE(sd->counter_active)) {
+        return;
+    }
+    atomic64_add(n, &sd->counter_value);
+    if (!test_and_set_bit(0, &sd->counter_redraw)) {
+        hrtimer_start_range_ns(&sd->counter_timer, ns_to_ktime(div_u64(NSEC_PER_SEC, sd->refresh_hz)), CONTENT_SLACK_NS,
+                               HRTIMER_MODE_REL);
+    }
+}
+
+/**
+ * Versão exportada: age sobre o display de minor 0 (/dev/sevenseg), se existir
+ */
+void sevenseg_counter_add(u64 n) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&primary_lock, flags);
+    if (primary_dev) {
+        counter_add(primary_dev, n);
+    }
+    spin_unlock_irqrestore(&primary_lock, flags);
+}
+EXPORT_SYMBOL_GPL(sevenseg_counter_add);
+
+/**
+ * Chamada com o lock da fila de espera do eventfd já obtido
+ */
+static int counter_wakeup(wait_queue_entry_t *wait, unsigned int mode, int sync, void *key) {
+    struct sevenseg_dev *sd = container_of(wait, struct sevenseg_dev, counter_wait);
+    __poll_t flags = key_to_poll(key);
+    u64 count;
+
+    if (flags & EPOLLIN) {
+        eventfd_ctx_do_read(sd->counter_ctx, &count);   // Zera o eventfd, assim o próximo sinal gera outro despertar
+        counter_add(sd, count);
+    }
+    if (flags & EPOLLHUP) {
+        list_del_init(&wait->entry);        // O eventfd foi fechado: saímos da fila, o contexto é liberado no unbind
+    }
+    return 0;
+}
+
+static void counter_queue_proc(struct file *file, wait_queue_head_t *wqh, poll_table *pt) {
+    struct sevenseg_dev *sd = container_of(pt, struct sevenseg_dev, counter_pt);
+
+    add_wait_queue(wqh, &sd->counter_wait);
+}
+
+/**
+ * Desliga o modo contador. Chamada com counter_lock obtido
+ */
+static void counter_unbind(struct sevenseg_dev *sd) {
+    u64 count;
+
+    WRITE_ONCE(sd->counter_active, false);
+    if (sd->counter_ctx) {
+        eventfd_ctx_remove_wait_queue(sd->counter_ctx, &sd->counter_wait, &count);
+        eventfd_ctx_put(sd->counter_ctx);
+        sd->counter_ctx = NULL;
+    }
+    hrtimer_cancel(&sd->counter_timer);
+    clear_bit(0, &sd->counter_redraw);
+}
+
+/**
+ * Display registrado na biblioteca line-display do auxdisplay (quando o Kernel
+ * a tem): o /sys/class/linedisp/linedisp.N/message e o scroll_step_ms são os
+ * mesmos dos outros drivers auxdisplay, e a rolagem fica a cargo do temporizador
+ * da biblioteca. Cada atualização dela desenha o buffer de caracteres no quadro
+ */
+#ifdef SEVENSEG_LINEDISP
+
+static inline bool linedisp_running(struct sevenseg_dev *sd) {
+    return READ_ONCE(sd->linedisp_ready) && timer_pending(&sd->linedisp.timer);
+}
+
+static inline void linedisp_stop(struct sevenseg_dev *sd) {
+    if (READ_ONCE(sd->linedisp_ready)) {
+        del_timer_sync(&sd->linedisp.timer);   // A mensagem continua no atributo, só a rolagem para
+    }
+}
+#else
+static inline bool linedisp_running(struct sevenseg_dev *sd) { return false; }
+static inline void linedisp_stop(struct sevenseg_dev *sd) {}
+#endif
+
+/**
+ * Indica se algum motor está gerando conteúdo no momento
+ */
+static bool content_engines_running(struct sevenseg_dev *sd) {
+    return hrtimer_active(&sd->scroll_timer) || hrtimer_active(&sd->anim_timer) || hrtimer_active(&sd->replay_timer) ||
+           delayed_work_pending(&sd->source_work) ||
+           READ_ONCE(sd->source_kind) != SOURCE_NONE || READ_ONCE(sd->counter_active) || linedisp_running(sd);
+}
+
+/**
+ * Para os motores do próprio driver (rolagem de texto, animações, reprodução
+ * do histórico, fontes de dados e contador). Pode dormir
+ */
+static void stop_driver_engines(struct sevenseg_dev *sd) {
+    hrtimer_cancel(&sd->scroll_timer);
+    anim_replace(sd, NULL, 0, 0);
+    replay_replace(sd, NULL, 0);
+    mutex_lock(&sd->source_lock);
+    sd->source_kind = SOURCE_NONE;
+    mutex_unlock(&sd->source_lock);
+    cancel_delayed_work_sync(&sd->source_work);
+    mutex_lock(&sd->counter_lock);
+    counter_unbind(sd);
+    mutex_unlock(&sd->counter_lock);
+}
+
+/**
+ * Para os "motores" que geram conteúdo sozinhos no Kernel (os do driver e a
+ * rolagem do line-display). Chamada quando o usuário escreve um quadro
+ * diretamente: vale o que foi escrito por último. Pode dormir
+ */
+static void stop_content_engines(struct sevenseg_dev *sd) {
+    stop_driver_engines(sd);
+    linedisp_stop(sd);
+}
+
+#ifdef SEVENSEG_LINEDISP
+/**
+ * Chamada pela biblioteca com o buffer já na posição de rolagem, a partir da
+ * escrita em 'message' (contexto de processo) ou do temporizador dela. Uma
+ * mensagem nova substitui os motores do driver, como qualquer outra escrita
+ */
+static void linedisp_update(struct linedisp *linedisp) {
+    u64 frame[SEVENSEG_MAX_DIGITS];
+
+    if (!READ_ONCE(sd->linedisp_ready)) {
+        return;
+    }
+    if (in_task()) {
+        stop_driver_engines(sd);
+    }
+    render_text(sd, linedisp->buf, linedisp->num_chars, 0, frame);
+    apply_frame(sd, frame, NULL, NULL);
+}
+
+static void register_linedisp(struct sevenseg_dev *sd) {
+    if (linedisp_register(&sd->linedisp, sd->device, sd->number_of_digits, sd->linedisp_chars, linedisp_update)) {
+        printk(KERN_WARNING "sevenseg: falha ao registrar no line-display\n");
+        return;
+    }
+    del_timer_sync(&sd->linedisp.timer);   // Sem a rolagem de boas-vindas: o display continua com o quadro atual
+    WRITE_ONCE(sd->linedisp_ready, true);
+}
+
+static void unregister_linedisp(struct sevenseg_dev *sd) {
+    if (sd->linedisp_ready) {
+        WRITE_ONCE(sd->linedisp_ready, false);
+        linedisp_unregister(&sd->linedisp);
+    }
+}
+#else
+static inline void register_linedisp(struct sevenseg_dev *sd) {}
+static inline void unregister_linedisp(struct sevenseg_dev *sd) {}
+#endif
+
+/**
+ * Lê um programa de animação do espaço do usuário e começa a tocá-lo
+ */
+static long anim_load(struct sevenseg_dev *sd, void __user *arg) {
+    struct sevenseg_anim_step *steps;
+    struct sevenseg_anim anim;
+
+    if (copy_from_user(&anim, arg, sizeof(anim))) {
+        return -EFAULT;
+    }
+    if (anim.count == 0 || anim.count > SEVENSEG_ANIM_MAX_STEPS) {
+        return -EINVAL;
+    }
+    steps = vmemdup_user(u64_to_user_ptr(anim.steps), anim.count * sizeof(*steps));
+    if (IS_ERR(steps)) {
+        return PTR_ERR(steps);
+    }
+    stop_content_engines(sd);
+    anim_replace(sd, steps, anim.count, anim.repeat);
+    return 0;
+}
+
+/**
+ * Liga o modo contador com o valor inicial 'value'. Com fd < 0 o contador só
+ * é alimentado por sevenseg_counter_add()
+ */
+static long counter_bind(struct sevenseg_dev *sd, void __user *arg) {
+    struct sevenseg_counter counter;
+    struct eventfd_ctx *ctx = NULL;
+    struct file *file = NULL;
+    u64 count;
+
+    if (copy_from_user(&counter, arg, sizeof(counter))) {
+        return -EFAULT;
+    }
+    if (counter.fd >= 0) {
+        file = eventfd_fget(counter.fd);
+        if (IS_ERR(file)) {
+            return PTR_ERR(file);
+        }
+        ctx = eventfd_ctx_fileget(file);
+        if (IS_ERR(ctx)) {
+            fput(file);
+            return PTR_ERR(ctx);
+        }
+    }
+
+    stop_content_engines(sd);
+    mutex_lock(&sd->counter_lock);
+    counter_unbind(sd);                       // Outro bind pode ter entrado entre o stop e o lock
+    atomic64_set(&sd->counter_value, counter.value);
+    WRITE_ONCE(sd->counter_active, true);
+    if (file) {
+        sd->counter_ctx = ctx;
+        init_waitqueue_func_entry(&sd->counter_wait, counter_wakeup);
+        init_poll_funcptr(&sd->counter_pt, counter_queue_proc);
+        // Sinais anteriores ao registro não geram despertar: consumimos o que
+        // estiver pendente até o eventfd ficar zerado com a gente na fila
+        while (vfs_poll(file, &sd->counter_pt) & EPOLLIN) {
+            eventfd_ctx_remove_wait_queue(ctx, &sd->counter_wait, &count);
+            atomic64_add(count, &sd->counter_value);
+        }
+        fput(file);
+    }
+    mutex_unlock(&sd->counter_lock);
+    counter_add(sd, 0);                     // Mostra o valor inicial
+    return 0;
+}
+
+/**
+ * O vetor de um iterador ITER_IOVEC passou a se chamar __iov no 6.4, lido
+ * através de iter_iov(); antes disso o campo era o próprio iov
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+#define iter_iov(iter) ((iter)->iov)
+#endif
+
+/**
+ * Tamanho do próximo quadro dentro de um writev(): cada segmento do vetor
+ * (iovec) é um quadro independente. Só é chamada para ITER_IOVEC com vários
+ * segmentos (um write() comum, que nos Kernels novos é ITER_UBUF, vai para write_stream())
+ */
+static size_t next_frame_len(const struct iov_iter *iter) {
+    return min(iov_iter_count(iter), iter_iov(iter)->iov_len - iter->iov_offset);
+}
+
+/**
+ * Leitor de fluxo de quadros: um quadro por linha ("1110111\n0110000\n...").
+ * Usado pelo write() comum e pelo splice()/sendfile(), em que os dados chegam
+ * em pedaços arbitrários e uma linha pode ficar dividida entre dois pedaços.
+ * Por isso guardamos o início de uma linha incompleta até o próximo pedaço
+ */
+struct sevenseg_stream {
+    char line[MAX_LINE_SIZE];
+    size_t len;                 // Caracteres acumulados da linha atual (o que passar de MAX_LINE_SIZE - 1 é descartado)
+};
+
+static void stream_feed(struct sevenseg_dev *sd, struct sevenseg_stream *stream, const char *data, size_t len) {
+    while (len > 0) {
+        const char *eol = memchr(data, '\n', len);
+        size_t chunk = eol ? eol - data : len;
+
+        if (eol && stream->len == 0) {
+            apply_message(sd, data, chunk);     // Linha inteira dentro do pedaço: aplicamos direto dele, sem copiar
+        } else {
+            if (stream->len < MAX_LINE_SIZE - 1) {
+                memcpy(stream->line + stream->len, data, min(chunk, MAX_LINE_SIZE - 1 - stream->len));
+            }
+            stream->len = min(stream->len + chunk, (size_t)MAX_LINE_SIZE - 1);
+            if (!eol) {
+                return;                     // Linha incompleta, o restante virá no próximo pedaço
+            }
+            apply_message(sd, stream->line, stream->len);
+        }
+        stream->len = 0;
+        data += chunk + 1;
+        len -= chunk + 1;
+    }
+}
+
+/**
+ * Aplica uma linha incompleta pendente (quadro sem '\n' no final)
+ */
+static void stream_flush(struct sevenseg_dev *sd, struct sevenseg_stream *stream) {
+    if (stream->len > 0) {
+        apply_message(sd, stream->line, stream->len);
+        stream->len = 0;
+    }
+}
+
+/**
+ * Posse dos pinos. Por padrão os pinos são pedidos na carga do módulo e só
+ * devolvidos no rmmod. Com lazy_pins, são pedidos no primeiro open() de
+ * /dev/sevenseg e devolvidos (apagados) release_delay_ms depois do último
+ * close(), liberando as linhas para outros usos em placas compartilhadas.
+ * Enquanto os pinos estão soltos, quadros escritos pelo sysfs, LEDs e motores
+ * só atualizam o framebuffer e aparecem na próxima vez que os pinos forem pedidos
+ */
+static bool lazy_pins;
+module_param(lazy_pins, bool, 0444);
+MODULE_PARM_DESC(lazy_pins, "Pede os GPIOs no primeiro open() e os devolve depois do ultimo close()");
+
+static unsigned int release_delay_ms = 2000;
+module_param(release_delay_ms, uint, 0644);
+MODULE_PARM_DESC(release_delay_ms, "Tempo de espera apos o ultimo close() antes de devolver os GPIOs (lazy_pins)");
+
+
+/**
+ * Solta os pinos. Com 'keep', os níveis atuais não são alterados
+ */
+static void release_pins(struct sevenseg_dev *sd, bool keep) {
+    for (int i = 0; i < sd->number_of_digit_pins; i++) {
+        if (!keep) {
+            gpio_set_value_cansleep(sd->digit_pins[i], 0);  // Apagamos os dígitos
+        }
+        gpio_free(sd->digit_pins[i]);
+    }
+
+    for (int i = 0; i < sd->number_of_charlie_pins; i++) {
+        if (!keep) {
+            gpio_direction_input(sd->charlie_pins[i]);  // Pinos soltos: nenhum LED aceso
+        }
+        gpio_free(sd->charlie_pins[i]);
+    }
+
+    // Liberamos e desconfiguramos os pinos GPIO usados
+    for (int i = 0; i < sd->number_of_pins && !charlieplexed(sd); i++) {
+        if (!keep) {
+            gpio_set_value_cansleep(sd->gpio_pins[i], 0);   // Desligamos os pinos (nível lógico baixo)
+        }
+        gpio_free(sd->gpio_pins[i]);                // Retornamos o controle do GPIO para o Kernel
+    }
+}
+
+/**
+ * Pede um pino ao Kernel. Linhas que podem dormir (expansores I2C/SPI,
+ * gpio-sim) são aceitas: quem escreve nelas é a thread do grupo da varredura
+ * (ver scan_group_thread()) ou a do charlieplexing
+ */
+static int claim_pin(struct sevenseg_dev *sd, unsigned int pin, const char *label) {
+    int result = gpio_request(pin, label);      // Solicita a permissão para utilizar o pino GPIO
+
+    if (result) {
+        printk(KERN_ALERT "sevenseg: falha na requisicao do pino GPIO %d (%d)\n", pin, result);
+        return result;
+    }
+    sd->lines_sleep |= gpio_cansleep(pin);
+    return 0;
+}
+
+/**
+ * Solicita os pinos ao Kernel. As saídas já nascem com o quadro que estiver
+ * no buffer da frente (apagado, ou initial_frame)
+ */
+static int request_pins(struct sevenseg_dev *sd) {
+    u64 initial = sd->scan_buffers[sd->tb_front].segments[0];
+    int result;
+
+    sd->lines_sleep = false;
+    if (charlieplexed(sd)) {
+        // Todos os pinos começam como entrada; a varredura acende o quadro inicial
+        for (int i = 0; i < sd->number_of_charlie_pins; i++) {
+            result = claim_pin(sd, sd->charlie_pins[i], "sevenseg-charlie");
+            if (result) {
+                for (int j = 0; j < i; j++) {
+                    gpio_free(sd->charlie_pins[j]);
+                }
+                return result;
+            }
+            gpio_direction_input(sd->charlie_pins[i]);
+            sd->charlie_state[i] = -1;
+        }
+    } else {
+        // Solicita ao Kernel e configura os pinos GPIO como saídas (referente a cada segmento do display)
+        for (int i = 0; i < sd->number_of_pins; i++) {
+            result = claim_pin(sd, sd->gpio_pins[i], "sevenseg-segment");
+            if (result) {
+                for (int j = 0; j < i; j++) {
+                    gpio_free(sd->gpio_pins[j]);            // Libera os GPIOs já solicitados em caso de falha
+                }
+                return result;                          // Retorna o erro do GPIO (chega ao open() com lazy_pins)
+            }
+            gpio_direction_output(sd->gpio_pins[i], !!(initial & BIT_ULL(i)));   // Configura o pino como saída já no estado inicial
+            sd->segment_descs[i] = gpio_to_desc(sd->gpio_pins[i]);
+        }
+    }
+
+    // Pinos de seleção dos dígitos (apenas em displays multiplexados), começam todos apagados
+    for (int i = 0; i < sd->number_of_digit_pins; i++) {
+        result = claim_pin(sd, sd->digit_pins[i], "sevenseg-digit");
+        if (result) {
+            for (int j = 0; j < i; j++) {
+                gpio_free(sd->digit_pins[j]);
+            }
+            // Devolvemos só o que foi pedido acima: as linhas de charlieplexing ou as de segmento
+            for (int j = 0; j < sd->number_of_charlie_pins && charlieplexed(sd); j++) {
+                gpio_free(sd->charlie_pins[j]);
+            }
+            for (int j = 0; j < sd->number_of_pins && !charlieplexed(sd); j++) {
+                gpio_free(sd->gpio_pins[j]);
+            }
+            return result;
+        }
+        gpio_direction_output(sd->digit_pins[i], 0);
+        sd->digit_descs[i] = gpio_to_desc(sd->digit_pins[i]);
+    }
+    return 0;
+}
+
+/**
+ * Grupo da varredura compartilhada para as linhas do display (criado se ainda
+ * não existir). As linhas de um display podem estar em controladores
+ * diferentes; o grupo é o do controlador da primeira linha de segmento, e o
+ * gpiolib divide cada lote entre os controladores. Displays com alguma linha
+ * que pode dormir ficam em um grupo à parte, com thread
+ */
+static struct scan_group *scan_group_get(struct sevenseg_dev *sd) {
+    struct gpio_chip *chip = gpiod_to_chip(sd->segment_descs[0]);
+    const void *owner = READ_ONCE(shared_scan) ? NULL : sd;
+    struct scan_group *g;
+
+    mutex_lock(&scan_groups_lock);
+    list_for_each_entry(g, &scan_groups, node) {
+        if (g->chip == chip && g->can_sleep == sd->lines_sleep && g->owner == owner) {
+            g->users++;
+            mutex_unlock(&scan_groups_lock);
+            return g;
+        }
+    }
+
+    g = kzalloc(sizeof(*g), GFP_KERNEL);
+    if (!g) {
+        mutex_unlock(&scan_groups_lock);
+        return ERR_PTR(-ENOMEM);
+    }
+    g->chip = chip;
+    g->owner = owner;
+    g->can_sleep = sd->lines_sleep;
+    g->users = 1;
+    mutex_init(&g->write_mutex);
+    spin_lock_init(&g->lock);
+    INIT_LIST_HEAD(&g->members);
+    g->since_ns = ktime_get_ns();
+    if (g->can_sleep) {
+        g->task = kthread_create(scan_group_thread, g, "sevenseg-%s", chip->label);
+        if (IS_ERR(g->task)) {
+            int result = PTR_ERR(g->task);
+
+            mutex_unlock(&scan_groups_lock);
+            kfree(g);
+            return ERR_PTR(result);
+        }
+        sched_set_fifo_low(g->task);            // Acima das tarefas comuns, para o display não piscar com a CPU ocupada
+        wake_up_process(g->task);
+    } else {
+        hrtimer_init(&g->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+        g->timer.function = scan_group_tick;
+    }
+    list_add(&g->node, &scan_groups);
+    mutex_unlock(&scan_groups_lock);
+    return g;
+}
+
+static void scan_group_free_arrays(struct gpio_desc **descs, unsigned long *zeros, unsigned long *seg_values, unsigned long *ones) {
+    kfree(descs);
+    bitmap_free(zeros);
+    bitmap_free(seg_values);
+    bitmap_free(ones);
+}
+
+static void scan_group_put(struct scan_group *g) {
+    mutex_lock(&scan_groups_lock);
+    if (--g->users > 0) {
+        mutex_unlock(&scan_groups_lock);
+        return;
+    }
+    list_del(&g->node);
+    mutex_unlock(&scan_groups_lock);
+
+    if (g->can_sleep) {
+        kthread_stop(g->task);
+    } else {
+        hrtimer_cancel(&g->timer);
+    }
+    scan_group_free_arrays(g->off, g->zeros, g->seg_values, g->ones);
+    kfree(g);
+}
+
+/**
+ * Coloca o display no seu grupo, que começa a varrê-lo na hora. Chamada com
+ * pins_mutex travado, depois de pedir os pinos
+ */
+static int scan_join(struct sevenseg_dev *sd) {
+    struct scan_group *g = scan_group_get(sd);
+    struct gpio_desc **descs = NULL;
+    unsigned long *zeros = NULL, *seg_values = NULL, *ones = NULL;
+    unsigned int capacity;
+    unsigned long flags;
+
+    if (IS_ERR(g)) {
+        return PTR_ERR(g);
+    }
+
+    mutex_lock(&g->write_mutex);
+    capacity = g->lines + sd->number_of_pins + 1;
+    if (capacity > g->capacity) {
+        // Os vetores só crescem; os novos são preparados fora do lock e trocados de uma vez
+        descs = kcalloc(3 * capacity, sizeof(*descs), GFP_KERNEL);
+        zeros = bitmap_zalloc(capacity, GFP_KERNEL);
+        seg_values = bitmap_zalloc(capacity, GFP_KERNEL);
+        ones = bitmap_zalloc(capacity, GFP_KERNEL);
+        if (!descs || !zeros || !seg_values || !ones) {
+            mutex_unlock(&g->write_mutex);
+            scan_group_free_arrays(descs, zeros, seg_values, ones);
+            scan_group_put(g);
+            return -ENOMEM;
+        }
+        bitmap_fill(ones, capacity);
+    }
+
+    spin_lock_irqsave(&g->lock, flags);
+    if (descs) {
+        swap(descs, g->off);
+        swap(zeros, g->zeros);
+        swap(seg_values, g->seg_values);
+        swap(ones, g->ones);
+        g->seg = g->off + capacity;
+        g->on = g->off + 2 * capacity;
+        g->capacity = capacity;
+    }
+    g->lines += sd->number_of_pins + 1;
+    sd->scan_dark = false;
+    sd->scan_parked = true;                     // O primeiro passo mostra o dígito 0
+    sd->scan_due = false;
+    sd->scan_slack_ns = 0;
+    sd->scan_deadline_ns = 0;
+    list_add_tail(&sd->scan_node, &g->members);
+    clear_bit(IDLE_REFRESH, &sd->idle_timers);
+    scan_group_kick(g);
+    spin_unlock_irqrestore(&g->lock, flags);
+    mutex_unlock(&g->write_mutex);
+    scan_group_free_arrays(descs, zeros, seg_values, ones);    // Os vetores antigos, se trocamos
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    sd->scan_group = g;
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+    return 0;
+}
+
+/**
+ * Tira o display do grupo. Na volta nenhum disparo do grupo mexe mais nos
+ * pinos dele. Chamada com pins_mutex travado, com scan_group já limpo
+ */
+static void scan_leave(struct scan_group *g, struct sevenseg_dev *sd) {
+    unsigned long flags;
+
+    mutex_lock(&g->write_mutex);
+    spin_lock_irqsave(&g->lock, flags);
+    list_del(&sd->scan_node);
+    g->lines -= sd->number_of_pins + 1;
+    spin_unlock_irqrestore(&g->lock, flags);
+    mutex_unlock(&g->write_mutex);
+    scan_group_put(g);
+}
+
+/**
+ * Pede os pinos e retoma a varredura e o PWM. Chamada com pins_mutex travado
+ */
+static int acquire_pins(struct sevenseg_dev *sd) {
+    u64 start = ktime_get_ns(), elapsed;
+    unsigned long flags;
+    int result;
+
+    result = request_pins(sd);
+    if (result) {
+        return result;
+    }
+    elapsed = ktime_get_ns() - start;
+    sd->stats.acquire_count++;
+    sd->stats.acquire_last_ns = elapsed;
+    sd->stats.acquire_max_ns = max(sd->stats.acquire_max_ns, elapsed);
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    sd->pins_held = true;
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+    if (charlieplexed(sd)) {
+        result = charlie_start(sd);
+        if (result) {
+            spin_lock_irqsave(&sd->pins_lock, flags);
+            sd->pins_held = false;
+            spin_unlock_irqrestore(&sd->pins_lock, flags);
+            release_pins(sd, false);
+            return result;
+        }
+    } else if (scanned(sd) || sd->lines_sleep) {
+        result = scan_join(sd);                 // Começa a varredura dos dígitos (ou as escritas pela thread)
+        if (result) {
+            spin_lock_irqsave(&sd->pins_lock, flags);
+            sd->pins_held = false;
+            spin_unlock_irqrestore(&sd->pins_lock, flags);
+            release_pins(sd, false);
+            return result;
+        }
+    }
+    if (!charlieplexed(sd) && !sd->scan_group && sd->brightness > 0 && sd->brightness < BRIGHTNESS_MAX) {
+        clear_bit(IDLE_PWM, &sd->idle_timers);
+        hrtimer_start(&sd->pwm_timer, 0, HRTIMER_MODE_REL);
+    }
+    return 0;
+}
+
+/**
+ * Para a varredura e o PWM e devolve os pinos. Com 'keep', o quadro atual fica
+ * nos pinos (fase acesa do PWM). Chamada com pins_mutex travado
+ */
+static void drop_pins(struct sevenseg_dev *sd, bool keep) {
+    struct scan_group *g;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    if (keep && !charlieplexed(sd) && !sd->scan_group) {
+        sd->pwm_phase_on = sd->brightness > 0;      // O PWM pode ter parado na fase apagada
+        show_current(sd);
+    }
+    sd->pins_held = false;                      // A partir daqui nenhum temporizador mexe nos pinos
+    g = sd->scan_group;
+    sd->scan_group = NULL;                      // Ninguém mais acorda o grupo por nós (show_current(), refresh_wake())
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+    hrtimer_cancel(&sd->pwm_timer);
+    charlie_stop(sd);
+    if (g) {
+        scan_leave(g, sd);
+    }
+    if (keep && charlieplexed(sd)) {
+        sd->pwm_phase_on = sd->brightness > 0;      // A thread pode ter parado na parte apagada do passo
+        charlie_show(sd);
+    }
+    if (keep && g) {
+        DECLARE_BITMAP(values, SEVENSEG_MAX_LINES);
+
+        // O grupo pode ter parado na parte apagada do passo: o dígito aceso volta a mostrar o seu conteúdo
+        bitmap_from_u64(values, sd->brightness > 0 ? sd->scan_buffers[sd->tb_front].segments[sd->scan_digit] : 0);
+        gpiod_set_raw_array_value_cansleep(sd->number_of_pins, sd->segment_descs, NULL, values);
+    }
+    release_pins(sd, keep);
+}
+
+static void pins_release_fn(struct work_struct *work) {
+    struct sevenseg_dev *sd = container_of(to_delayed_work(work), struct sevenseg_dev, pins_release_work);
+
+    mutex_lock(&sd->pins_mutex);
+    if (sd->pin_users == 0 && sd->pins_held) {      // Alguém pode ter aberto o arquivo de novo durante a espera
+        drop_pins(sd, false);
+    }
+    mutex_unlock(&sd->pins_mutex);
+}
+
+/**
+ * Referência aos pinos de cada arquivo aberto. Os pinos só são pedidos aqui
+ * com lazy_pins, mas a contagem também impede desligar pelo configfs um
+ * display que ainda está aberto
+ */
+static int pins_get(struct sevenseg_dev *sd) {
+    int result = 0;
+
+    mutex_lock(&sd->pins_mutex);
+    if (lazy_pins) {
+        cancel_delayed_work(&sd->pins_release_work);    // Se já estiver rodando, vê pin_users > 0 e não solta nada
+        if (!sd->pins_held) {
+            result = acquire_pins(sd);
+        }
+    }
+    if (!result) {
+        sd->pin_users++;
+    }
+    mutex_unlock(&sd->pins_mutex);
+    return result;
+}
+
+static void pins_put(struct sevenseg_dev *sd) {
+    mutex_lock(&sd->pins_mutex);
+    if (--sd->pin_users == 0 && sd->down_pending) {
+        kref_get(&sd->ref);                         // Solta no fim do trabalho
+        queue_work(sevenseg_wq, &sd->instance_down_work);   // O release() roda dentro do próprio chardev: o cdev_del() fica para depois
+    } else if (sd->pin_users == 0 && lazy_pins) {
+        schedule_delayed_work(&sd->pins_release_work, msecs_to_jiffies(release_delay_ms));
+    }
+    mutex_unlock(&sd->pins_mutex);
+}
+
+/**
+ * Última referência: o display já foi desligado e ninguém mais o alcança. O
+ * minor volta a ficar livre para outra instância
+ */
+static void sevenseg_dev_release(struct kref *ref) {
+    struct sevenseg_dev *sd = container_of(ref, struct sevenseg_dev, ref);
+
+    mutex_lock(&sevenseg_minors_lock);
+    idr_remove(&sevenseg_minors, sd->minor);
+    mutex_unlock(&sevenseg_minors_lock);
+    cancel_work_sync(&sd->genl_work);
+    kvfree(sd->history);
+    kvfree(sd);
+}
+
+static void sevenseg_dev_put(struct sevenseg_dev *sd) {
+    kref_put(&sd->ref, sevenseg_dev_release);
+}
+
+/**
+ * Estado de cada arquivo aberto (cada open() de /dev/sevenseg)
+ */
+struct sevenseg_file {
+    struct sevenseg_dev *sd;        // Display do minor aberto (com uma referência)
+    struct mutex lock;
+    struct sevenseg_stream stream;  // Linha pendente entre chamadas de splice()
+    spinlock_t sched_lock;          // Protege a lista de quadros agendados e a fila de relatórios
+    struct list_head scheduled;     // Quadros agendados (SCHEDULE) ainda não aplicados
+    unsigned int nr_scheduled;
+    DECLARE_KFIFO(presented, struct sevenseg_present, SEVENSEG_SCHEDULE_MAX);
+    wait_queue_head_t present_wq;   // Acordada a cada relatório novo (ioctl PRESENT e poll())
+};
+
+static inline struct sevenseg_dev *file_dev(struct file *filep) {
+    return ((struct sevenseg_file *)filep->private_data)->sd;
+}
+
+/**
+ * Quadro agendado para um instante absoluto de CLOCK_MONOTONIC ou CLOCK_TAI.
+ * Diferente de SET_FRAME_AT, quem agenda não espera: o resultado (instante
+ * real de aplicação e atraso) vira um relatório na fila do arquivo, lido com
+ * o ioctl PRESENT. Vários processos (ou várias máquinas com o relógio TAI
+ * sincronizado por PTP) conseguem trocar de quadro juntos
+ */
+struct sevenseg_sched {
+    struct hrtimer timer;
+    struct list_head node;              // Em sevenseg_file.scheduled; vazio quando o release está cancelando
+    struct sevenseg_file *owner;
+    u64 segments[SEVENSEG_MAX_DIGITS];
+    struct sevenseg_present report;     // cookie, target_ns e clockid já preenchidos no agendamento
+};
+
+static enum hrtimer_restart sched_fire(struct hrtimer *timer) {
+    struct sevenseg_sched *sched = container_of(timer, struct sevenseg_sched, timer);
+    struct sevenseg_file *file = sched->owner;
+    struct sevenseg_dev *sd = file->sd;
+    struct sevenseg_frame frame;
+    unsigned long flags;
+
+    // O lock fica com a gente até o fim: o release não libera o arquivo no meio do disparo
+    spin_lock_irqsave(&file->sched_lock, flags);
+    if (list_empty(&sched->node)) {     // O release já tirou este agendamento da lista e vai liberá-lo
+        spin_unlock_irqrestore(&file->sched_lock, flags);
+        return HRTIMER_NORESTART;
+    }
+    list_del_init(&sched->node);
+    file->nr_scheduled--;
+
+    apply_frame(sd, sched->segments, NULL, &frame);
+    sched->report.seq = frame.seq;
+    sched->report.latch_ns = frame.latch_ns;
+    if (sched->report.clockid == CLOCK_TAI) {   // O instante de aplicação vem no mesmo relógio do pedido
+        sched->report.latch_ns = ktime_to_ns(ktime_mono_to_any(ns_to_ktime(frame.latch_ns), TK_OFFS_TAI));
+    }
+    sched->report.lateness_ns = (s64)(sched->report.latch_ns - sched->report.target_ns);
+    kfifo_put(&file->presented, sched->report); // Sempre cabe: agendados + relatórios nunca passam de SEVENSEG_SCHEDULE_MAX
+    wake_up_interruptible_poll(&file->present_wq, EPOLLPRI);
+    spin_unlock_irqrestore(&file->sched_lock, flags);
+
+    kfree(sched);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * Lê de 'arg' um pedido de SCHEDULE e arma o temporizador
+ */
+static long sched_submit(struct sevenseg_dev *sd, struct sevenseg_file *file, void __user *arg) {
+    struct sevenseg_schedule req;
+    struct sevenseg_sched *sched;
+    unsigned long flags;
+
+    if (copy_from_user(&req, arg, sizeof(req))) {
+        return -EFAULT;
+    }
+    if ((req.clockid != CLOCK_MONOTONIC && req.clockid != CLOCK_TAI) || req.reserved) {
+        return -EINVAL;
+    }
+    sched = kzalloc(sizeof(*sched), GFP_KERNEL);
+    if (!sched) {
+        return -ENOMEM;
+    }
+    memcpy(sched->segments, req.frame.segments, sizeof(sched->segments));
+    sched->owner = file;
+    sched->report.cookie = req.cookie;
+    sched->report.target_ns = req.when_ns;
+    sched->report.clockid = req.clockid;
+    hrtimer_init(&sched->timer, req.clockid, HRTIMER_MODE_ABS);
+    sched->timer.function = sched_fire;
+
+    stop_content_engines(sd);
+    spin_lock_irqsave(&file->sched_lock, flags);
+    if (file->nr_scheduled + kfifo_len(&file->presented) >= SEVENSEG_SCHEDULE_MAX) {
+        spin_unlock_irqrestore(&file->sched_lock, flags);
+        kfree(sched);
+        return -EBUSY;                  // Leia os relatórios pendentes antes de agendar mais
+    }
+    list_add_tail(&sched->node, &file->scheduled);
+    file->nr_scheduled++;
+    hrtimer_start(&sched->timer, ns_to_ktime(req.when_ns), HRTIMER_MODE_ABS);  // Se o instante já passou, dispara imediatamente
+    spin_unlock_irqrestore(&file->sched_lock, flags);
+    return 0;
+}
+
+/**
+ * Retira o relatório mais antigo da fila. Sem O_NONBLOCK, espera até haver um
+ */
+static long present_read(struct sevenseg_file *file, void __user *arg, bool nonblock) {
+    struct sevenseg_present report;
+    unsigned long flags;
+    unsigned int got;
+
+    for (;;) {
+        spin_lock_irqsave(&file->sched_lock, flags);
+        got = kfifo_get(&file->presented, &report);
+        spin_unlock_irqrestore(&file->sched_lock, flags);
+        if (got) {
+            break;
+        }
+        if (nonblock) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(file->present_wq, !kfifo_is_empty(&file->presented))) {
+            return -ERESTARTSYS;
+        }
+    }
+    return copy_to_user(arg, &report, sizeof(report)) ? -EFAULT : 0;
+}
+
+/**
+ * Cancela os quadros agendados que ainda não foram aplicados (no fechamento do arquivo)
+ */
+static void sched_cancel_all(struct sevenseg_file *file) {
+    struct sevenseg_sched *sched;
+    unsigned long flags;
+
+    spin_lock_irqsave(&file->sched_lock, flags);
+    while (!list_empty(&file->scheduled)) {
+        sched = list_first_entry(&file->scheduled, struct sevenseg_sched, node);
+        list_del_init(&sched->node);
+        spin_unlock_irqrestore(&file->sched_lock, flags);
+        hrtimer_cancel(&sched->timer);  // Espera um disparo em andamento, que vai ver o nó vazio e sair
+        kfree(sched);
+        spin_lock_irqsave(&file->sched_lock, flags);
+    }
+    file->nr_scheduled = 0;
+    spin_unlock_irqrestore(&file->sched_lock, flags);
+}
+
+/**
+ * Função chamada quando o dispositivo é aberto
+ * (quando vai trocar dados - lembrar do fopen() da linguagem C)
+ */
+static int dev_open(struct inode *inodep, struct file *filep) {
+    struct sevenseg_file *file = kzalloc(sizeof(*file), GFP_KERNEL);
+    struct sevenseg_dev *sd;
+    int result;
+
+    if (!file) {
+        return -ENOMEM;
+    }
+    // Sob sevenseg_minors_lock até contar o arquivo: sevenseg_dev_hide() não desliga o display no meio
+    mutex_lock(&sevenseg_minors_lock);
+    sd = idr_find(&sevenseg_minors, iminor(inodep));
+    result = sd ? pins_get(sd) : -ENODEV;   // Sem display: ele foi desligado depois do lookup do /dev
+    if (!result) {
+        kref_get(&sd->ref);
+    }
+    mutex_unlock(&sevenseg_minors_lock);
+    if (result) {
+        kfree(file);
+        return result;
+    }
+    file->sd = sd;
+    mutex_init(&file->lock);
+    spin_lock_init(&file->sched_lock);
+    INIT_LIST_HEAD(&file->scheduled);
+    INIT_KFIFO(file->presented);
+    init_waitqueue_head(&file->present_wq);
+    filep->private_data = file;
+    filep->f_mode |= FMODE_NOWAIT;  // Nosso caminho de escrita nunca dorme (apenas spinlock), então o io_uring pode
+                                    // submeter escritas diretamente, sem repassá-las para uma thread auxiliar
+    printk(KERN_INFO "sevenseg: character device aberto\n");
+    return 0; // Retorna 0 para indicar sucesso
+}
+
+/**
+ * Função chamada quando o dispositivo é fechado
+ * (quando já terminou de trocar dados - lembrar do fclose() da linguagem C)
+ */
+static int dev_release(struct inode *inodep, struct file *filep) {
+    struct sevenseg_file *file = filep->private_data;
+    struct sevenseg_dev *sd = file->sd;
+
+    stream_flush(sd, &file->stream);    // Um último quadro sem '\n' recebido via splice ainda é aplicado
+    sched_cancel_all(file);
+    kfree(file);
+    pins_put(sd);
+    sevenseg_dev_put(sd);
+    printk(KERN_INFO "sevenseg: character device fechado\n");
+    return 0; // Retorna 0 para indicar sucesso
+}
+
+/**
+ * Escrita de um fluxo de quadros separados por '\n' (write() comum). Copiamos
+ * em pedaços pequenos para a pilha, então não há limite para o tamanho da
+ * escrita: "cat animacao.txt > /dev/sevenseg" aplica todas as linhas. A
+ * última linha não precisa terminar em '\n', como em "echo -n 1110111".
+ * Fica fora do dev_write_iter() para que as duas linhas de até MAX_LINE_SIZE
+ * não dividam a mesma pilha
+ */
+static noinline_for_stack ssize_t write_stream(struct sevenseg_dev *sd, struct iov_iter *from) {
+    struct sevenseg_stream stream = { .len = 0 };
+    size_t written = 0;
+    char chunk[64];
+
+    while (iov_iter_count(from) > 0) {
+        size_t len = min(iov_iter_count(from), sizeof(chunk));
+
+        if (copy_from_iter(chunk, len, from) != len) {  // Copia os dados do espaço do usuário para o Kernel (de from -> chunk)
+            printk(KERN_ERR "sevenseg: falha na recepcao de dados\n");
+            return written ? written : -EFAULT;         // Se algum quadro já foi aplicado, retornamos o que foi consumido até aqui
+        }
+        stream_feed(sd, &stream, chunk, len);
+        written += len;
+    }
+    stream_flush(sd, &stream);
+    return written;
+}
+
+/**
+ * Função chamada quando o dispositivo recebe dados a partir
+ * do espaço do usuário (lembrar do fwrite() da linguagem C).
+ *
+ * Usamos a interface write_iter no lugar do antigo .write: ela atende write(),
+ * writev() e o io_uring pelo mesmo caminho. Um buffer único (write() comum) é
+ * lido como fluxo, um quadro por linha; em um writev() com vários segmentos
+ * cada segmento é um quadro, então vários quadros chegam em uma única syscall.
+ * A escolha depende só do número de segmentos, e não do tipo do iterador
+ * (que para um write() é ITER_UBUF ou ITER_IOVEC conforme a versão do Kernel)
+ */
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    struct sevenseg_dev *sd = file_dev(iocb->ki_filp);
+    size_t written = 0;
+
+    if (content_engines_running(sd)) {
+        if (iocb->ki_flags & IOCB_NOWAIT) {
+            return -EAGAIN;                     // Parar os motores pode dormir: o io_uring repete a escrita em uma thread auxiliar
+        }
+        stop_content_engines(sd);
+    }
+    if (!iter_is_iovec(from) || from->nr_segs <= 1) {
+        return write_stream(sd, from);
+    }
+
+    while (iov_iter_count(from) > 0) {
+        char message[MAX_LINE_SIZE] = {0};      // String para armazenar a mensagem binária recebida do usuário (um caractere por linha de cada dígito + '\0')
+        size_t frame_len = next_frame_len(from);
+        size_t copy_len = min_t(size_t, frame_len, MAX_LINE_SIZE - 1); // Truncamos no tamanho máximo de uma linha - proteção contra buffer overflow
+
+        if (copy_from_iter(message, copy_len, from) != copy_len) {     // Copia os dados do espaço do usuário para o Kernel (de from -> message)
+            printk(KERN_ERR "sevenseg: falha na recepcao de dados\n");
+            return written ? written : -EFAULT; // Se algum quadro já foi aplicado, retornamos o que foi consumido até aqui
+        }
+        iov_iter_advance(from, frame_len - copy_len);   // Descarta o restante do segmento (além do tamanho máximo)
+        apply_message(sd, message, copy_len);
+        written += frame_len;
+    }
+    pr_debug("sevenseg: recebeu %zu caracteres do usuario\n", written);
+    return written; // Retorna o número de bytes escritos (obrigatório)
+}
+
+/**
+ * Consome um buffer do pipe: a página é mapeada e os quadros são lidos
+ * diretamente dela, sem passar por nenhum buffer no espaço do usuário
+ */
+static int pipe_to_frames(struct pipe_inode_info *pipe, struct pipe_buffer *buf, struct splice_desc *desc) {
+    struct sevenseg_file *file = desc->u.file->private_data;
+    char *data = kmap_local_page(buf->page);
+
+    stream_feed(file->sd, &file->stream, data + buf->offset, desc->len);
+    kunmap_local(data);
+    return desc->len;
+}
+
+/**
+ * Função chamada pelo splice() e pelo sendfile() quando o destino é o
+ * dispositivo. Permite tocar uma animação gravada em arquivo com
+ * "sendfile(dev, arquivo)" ou receber quadros de um processo gerador por um pipe
+ */
+static ssize_t dev_splice_write(struct pipe_inode_info *pipe, struct file *filep, loff_t *ppos, size_t len, unsigned int flags) {
+    struct sevenseg_file *file = filep->private_data;
+    ssize_t ret;
+
+    stop_content_engines(file->sd);
+    mutex_lock(&file->lock);    // A linha pendente é do arquivo, então dois splice() simultâneos não podem misturá-la
+    ret = splice_from_pipe(pipe, filep, ppos, len, flags, pipe_to_frames);
+    mutex_unlock(&file->lock);
+    return ret;
+}
+
+/**
+ * Função chamada quando os dados registrados no dispositivo são lidos
+ * e enviados para o espaço do usuário (lembrar do fread() da linguagem C)
+ */
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    struct sevenseg_dev *sd = file_dev(iocb->ki_filp);
+    char segment_states[MAX_LINE_SIZE]; // String para armazenar os estados dos segmentos do display
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    size_t copied;
+    int len;
+
+    // Se já leu o arquivo uma vez durante esta chamada, retorna 0 para indicar que não há mais dados a serem lidos
+    if (iocb->ki_pos > 0) {
+        return 0;
+    }
+
+    snapshot_frame(sd, frame);
+    len = frame_to_string(sd, frame, segment_states);   // Montamos a string binária a partir do framebuffer, sem precisar consultar cada pino GPIO
+    segment_states[len++] = '\0';                   // Temos que adicionar o terminador de string (null terminator)
+
+    // Copia a string binária com o estado dos segmentos de volta para o espaço do usuário (de segment_states -> to)
+    copied = copy_to_iter(segment_states, len, to);
+    if (copied == 0 && iov_iter_count(to) > 0) {
+        printk(KERN_ERR "sevenseg: falha no envio de dados\n");
+        return -EFAULT; // Retorna erro se a cópia falhar
+    }
+
+    pr_debug("sevenseg: enviou %zu caracteres para o usuario\n", copied);
+    iocb->ki_pos += copied; // Atualiza o offset para evitar leituras repetidas (lembrar do fseek() da linguagem C)
+    return copied;          // Retorna o número de bytes lidos (obrigatório)
+}
+
+/**
+ * Requisição de quadro agendado (SET_FRAME_AT). Um temporizador de alta
+ * resolução aplica o quadro no instante pedido e então avisa quem fez o
+ * pedido: o ioctl (via completion) ou o io_uring (gerando a CQE)
+ */
+struct sevenseg_timed_req {
+    struct hrtimer timer;
+    struct sevenseg_dev *sd;
+    struct sevenseg_frame report;       // Entrada: quadro a aplicar; saída: seq e instante de publicação
+    struct io_uring_cmd *ioucmd;        // Comando io_uring de origem (NULL quando veio de um ioctl)
+    fl_owner_t owner;                   // Tabela de descritores de quem submeteu (apenas io_uring)
+    struct list_head node;              // Entrada na lista timed_waiters (apenas io_uring)
+    struct completion done;
+};
+
+static enum hrtimer_restart timed_frame_fire(struct hrtimer *timer) {
+    struct sevenseg_timed_req *req = container_of(timer, struct sevenseg_timed_req, timer);
+    struct sevenseg_dev *sd = req->sd;
+    unsigned long flags;
+
+    if (req->ioucmd) {
+        spin_lock_irqsave(&sd->frame_lock, flags);
+        list_del(&req->node);           // A partir daqui o dev_flush() não o cancela mais: completamos abaixo
+        spin_unlock_irqrestore(&sd->frame_lock, flags);
+    }
+    apply_frame(sd, req->report.segments, NULL, &req->report);
+    if (req->ioucmd) {
+        io_uring_cmd_complete_in_task(req->ioucmd, uring_cmd_complete);
+    } else {
+        complete(&req->done);
+    }
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * Lê de 'arg' um pedido de SET_FRAME_AT e arma o temporizador
+ */
+static struct sevenseg_timed_req *timed_req_submit(struct sevenseg_dev *sd, void __user *arg, struct io_uring_cmd *ioucmd) {
+    struct sevenseg_timed_frame timed;
+    struct sevenseg_timed_req *req;
+    unsigned long flags;
+
+    if (copy_from_user(&timed, arg, sizeof(timed))) {
+        return ERR_PTR(-EFAULT);
+    }
+    req = kzalloc(sizeof(*req), GFP_KERNEL);
+    if (!req) {
+        return ERR_PTR(-ENOMEM);
+    }
+    stop_content_engines(sd);
+    req->sd = sd;
+    req->report = timed.frame;
+    req->ioucmd = ioucmd;
+    req->owner = current->files;        // As threads do io_uring (io-wq, SQPOLL) compartilham a tabela de quem submeteu
+    if (ioucmd) {
+        cmd_pdu(ioucmd)->req = req;     // Precisa estar preenchido antes do temporizador ser armado
+    }
+    init_completion(&req->done);
+    hrtimer_init(&req->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    req->timer.function = timed_frame_fire;
+    if (ioucmd) {
+        spin_lock_irqsave(&sd->frame_lock, flags);
+        list_add_tail(&req->node, &sd->timed_waiters);
+        spin_unlock_irqrestore(&sd->frame_lock, flags);
+    }
+    hrtimer_start(&req->timer, ns_to_ktime(timed.when_ns), HRTIMER_MODE_ABS);   // Se o instante já passou, dispara imediatamente
+    return req;
+}
+
+/**
+ * Executado no contexto do processo que submeteu o comando io_uring (por isso
+ * podemos usar copy_to_user aqui): escreve a resposta e gera a CQE
+ */
+static void uring_cmd_complete(struct io_uring_cmd *ioucmd) {
+    struct sevenseg_cmd_pdu *pdu = cmd_pdu(ioucmd);
+    struct sevenseg_dev *sd = file_dev(ioucmd->file);
+    struct sevenseg_frame report;
+    unsigned long flags;
+    int ret = 0;
+
+    if (IS_ERR(pdu->req)) {
+        io_uring_cmd_done(ioucmd, PTR_ERR(pdu->req), 0);   // Cancelado pelo dev_flush()
+        return;
+    }
+    if (pdu->req) {
+        report = pdu->req->report;      // Estado exato do momento em que o quadro agendado foi aplicado
+        kfree(pdu->req);
+    } else {
+        spin_lock_irqsave(&sd->frame_lock, flags);
+        fill_report(sd, &report);
+        spin_unlock_irqrestore(&sd->frame_lock, flags);
+    }
+    if (copy_to_user(pdu->arg, &report, sizeof(report))) {
+        ret = -EFAULT;
+    }
+    io_uring_cmd_done(ioucmd, ret, 0);
+}
+
+/**
+ * Operações síncronas comuns ao ioctl e ao io_uring
+ */
+static long frame_get(struct sevenseg_dev *sd, void __user *arg) {
+    struct sevenseg_frame report;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    fill_report(sd, &report);
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+    return copy_to_user(arg, &report, sizeof(report)) ? -EFAULT : 0;
+}
+
+/**
+ * Com 'nowait' (io_uring sem poder dormir) só seguimos se não houver motor
+ * para parar: o resto do caminho usa apenas spinlocks
+ */
+static long frame_set(struct sevenseg_dev *sd, void __user *arg, bool nowait) {
+    struct sevenseg_frame frame;
+
+    if (copy_from_user(&frame, arg, sizeof(frame))) {
+        return -EFAULT;
+    }
+    if (content_engines_running(sd)) {
+        if (nowait) {
+            return -EAGAIN;
+        }
+        stop_content_engines(sd);
+    }
+    apply_frame(sd, frame.segments, NULL, &frame);  // Quando apply_frame retorna, o quadro já foi publicado para a varredura
+    return copy_to_user(arg, &frame, sizeof(frame)) ? -EFAULT : 0;
+}
+
+/**
+ * Função chamada para comandos de controle (ioctl) enviados ao dispositivo
+ */
+static long dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    void __user *argp = (void __user *)arg;
+    struct sevenseg_dev *sd = file_dev(filep);
+    struct sevenseg_timed_req *req;
+    struct sevenseg_frame frame;
+    long ret;
+
+    switch (cmd) {
+    case SEVENSEG_IOC_GET_FRAME:
+        return frame_get(sd, argp);
+
+    case SEVENSEG_IOC_SET_FRAME:
+        return frame_set(sd, argp, false);
+
+    case SEVENSEG_IOC_SET_FRAME_AT:
+        req = timed_req_submit(sd, argp, NULL);
+        if (IS_ERR(req)) {
+            return PTR_ERR(req);
+        }
+        ret = wait_for_completion_interruptible(&req->done);
+        if (ret) {
+            hrtimer_cancel(&req->timer);    // Interrompido por um sinal: cancela o agendamento (ou espera o disparo em andamento)
+        } else if (copy_to_user(argp, &req->report, sizeof(req->report))) {
+            ret = -EFAULT;
+        }
+        kfree(req);
+        return ret;
+
+    case SEVENSEG_IOC_WAIT_CHANGE:
+        if (copy_from_user(&frame, argp, sizeof(frame))) {
+            return -EFAULT;
+        }
+        if (wait_event_interruptible(sd->frame_wq, READ_ONCE(sd->frame_seq) != frame.seq)) {
+            return -ERESTARTSYS;
+        }
+        return frame_get(sd, argp);
+
+    case SEVENSEG_IOC_ANIM_LOAD:
+        return anim_load(sd, argp);
+
+    case SEVENSEG_IOC_COUNTER:
+        return counter_bind(sd, argp);
+
+    case SEVENSEG_IOC_SCHEDULE:
+        return sched_submit(sd, filep->private_data, argp);
+
+    case SEVENSEG_IOC_PRESENT:
+        return present_read(filep->private_data, argp, filep->f_flags & O_NONBLOCK);
+
+    case SEVENSEG_IOC_ANIM_STOP:
+        stop_content_engines(sd);
+        return 0;
+    }
+    return -ENOTTY;
+}
+
+/**
+ * Função chamada para comandos assíncronos do io_uring (IORING_OP_URING_CMD).
+ * Expõe as mesmas operações do ioctl, mas SET_FRAME_AT e WAIT_CHANGE não
+ * bloqueiam: retornamos -EIOCBQUEUED e a CQE é gerada depois, quando o quadro
+ * é publicado (ou quando a mudança esperada acontece)
+ */
+static int dev_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+    const struct sevenseg_uring_cmd *cmd = ioucmd->cmd;
+    struct sevenseg_cmd_pdu *pdu = cmd_pdu(ioucmd);
+    struct sevenseg_dev *sd = file_dev(ioucmd->file);
+    struct sevenseg_timed_req *req;
+    struct sevenseg_frame frame;
+    unsigned long flags;
+
+    pdu->arg = u64_to_user_ptr(READ_ONCE(cmd->addr));
+    pdu->req = NULL;
+
+    // Os demais comandos de escrita alocam memória ou travam mutexes: sem poder dormir, o io_uring
+    // os repete em uma thread auxiliar. SET_FRAME só dorme se houver um motor de conteúdo para parar
+    if ((issue_flags & IO_URING_F_NONBLOCK) && ioucmd->cmd_op != SEVENSEG_IOC_GET_FRAME &&
+        ioucmd->cmd_op != SEVENSEG_IOC_SET_FRAME && ioucmd->cmd_op != SEVENSEG_IOC_WAIT_CHANGE &&
+        ioucmd->cmd_op != SEVENSEG_IOC_PRESENT) {
+        return -EAGAIN;
+    }
+
+    switch (ioucmd->cmd_op) {
+    case SEVENSEG_IOC_GET_FRAME:
+        return frame_get(sd, pdu->arg);
+
+    case SEVENSEG_IOC_SET_FRAME:
+        return frame_set(sd, pdu->arg, issue_flags & IO_URING_F_NONBLOCK);
+
+    case SEVENSEG_IOC_SET_FRAME_AT:
+        req = timed_req_submit(sd, pdu->arg, ioucmd);
+        if (IS_ERR(req)) {
+            return PTR_ERR(req);
+        }
+        return -EIOCBQUEUED;
+
+    case SEVENSEG_IOC_WAIT_CHANGE:
+        if (copy_from_user(&frame, pdu->arg, sizeof(frame))) {
+            return -EFAULT;
+        }
+        spin_lock_irqsave(&sd->frame_lock, flags);
+        if (sd->frame_seq != frame.seq) {       // Já mudou desde o quadro que o usuário conhece: responde na hora
+            spin_unlock_irqrestore(&sd->frame_lock, flags);
+            return frame_get(sd, pdu->arg);
+        }
+        pdu->owner = current->files;
+        list_add_tail(&pdu->node, &sd->change_waiters);
+        spin_unlock_irqrestore(&sd->frame_lock, flags);
+        return -EIOCBQUEUED;
+
+    case SEVENSEG_IOC_ANIM_LOAD:
+        return anim_load(sd, pdu->arg);
+
+    case SEVENSEG_IOC_COUNTER:
+        return counter_bind(sd, pdu->arg);
+
+    case SEVENSEG_IOC_SCHEDULE:
+        return sched_submit(sd, ioucmd->file->private_data, pdu->arg);
+
+    case SEVENSEG_IOC_PRESENT:                  // Nunca espera: use poll() (ou IORING_OP_POLL_ADD) antes
+        return present_read(ioucmd->file->private_data, pdu->arg, true);
+
+    case SEVENSEG_IOC_ANIM_STOP:
+        stop_content_engines(sd);
+        return 0;
+    }
+    return -ENOTTY;
+}
+
+static int same_file(const void *filep, struct file *file, unsigned int fd) {
+    return file == filep;
+}
+
+/**
+ * Chamada a cada close() de um descritor deste arquivo, inclusive quando o
+ * processo termina ('id' é a tabela de descritores de onde ele saiu). Comandos
+ * io_uring pendentes (WAIT_CHANGE esperando uma mudança, SET_FRAME_AT esperando
+ * o instante) seguram o arquivo, e sem um cancelamento aqui terminar o processo
+ * ficaria preso até o próximo quadro. Cancelamos, com -ECANCELED, só os
+ * comandos submetidos a partir desta tabela e só quando ela fecha o seu último
+ * descritor do arquivo: fechar um dup() ou o término de um filho do fork() não
+ * afeta os comandos do processo original. O fim do próprio anel não passa por
+ * aqui: antes do 6.7 (IORING_URING_CMD_CANCELABLE) um io_uring_queue_exit() com
+ * o dispositivo ainda aberto espera o próximo quadro (ou o instante agendado)
+ */
+static int dev_flush(struct file *filep, fl_owner_t id) {
+    struct sevenseg_dev *sd = file_dev(filep);
+    struct sevenseg_timed_req *req, *next;
+    struct sevenseg_cmd_pdu *pdu, *tmp;
+    unsigned long flags;
+    LIST_HEAD(cancelled);
+
+    // O descritor que está sendo fechado já saiu da tabela: se outro ainda aponta para o arquivo, nada a fazer
+    if (!id || iterate_fd(id, 0, same_file, filep)) {
+        return 0;
+    }
+
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    list_for_each_entry_safe(pdu, tmp, &sd->change_waiters, node) {
+        if (pdu_cmd(pdu)->file == filep && pdu->owner == id) {
+            list_move_tail(&pdu->node, &cancelled);
+        }
+    }
+    list_for_each_entry_safe(req, next, &sd->timed_waiters, node) {
+        // Se o temporizador já está disparando, o próprio disparo completa o comando
+        if (req->ioucmd->file == filep && req->owner == id && hrtimer_try_to_cancel(&req->timer) == 1) {
+            list_del(&req->node);
+            pdu = cmd_pdu(req->ioucmd);
+            list_add_tail(&pdu->node, &cancelled);
+            kfree(req);
+        }
+    }
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+
+    list_for_each_entry_safe(pdu, tmp, &cancelled, node) {
+        list_del(&pdu->node);
+        pdu->req = ERR_PTR(-ECANCELED);
+        io_uring_cmd_complete_in_task(pdu_cmd(pdu), uring_cmd_complete);
+    }
+    return 0;
+}
+
+/**
+ * poll(): escrever é sempre possível; EPOLLPRI indica relatórios de quadros
+ * agendados prontos para o ioctl PRESENT
+ */
+static __poll_t dev_poll(struct file *filep, poll_table *wait) {
+    struct sevenseg_file *file = filep->private_data;
+    __poll_t mask = EPOLLOUT | EPOLLWRNORM;
+
+    poll_wait(filep, &file->present_wq, wait);
+    if (!kfifo_is_empty(&file->presented)) {
+        mask |= EPOLLPRI;
+    }
+    return mask;
+}
+
+/**
+ * Estrutura obrigatória que define as operações de arquivo do dispositivo (open, read, write, release),
+ * além dos comandos de controle síncronos (ioctl) e assíncronos (io_uring)
+ */
+static struct file_operations fops = {
+    .open = dev_open,
+    .write_iter = dev_write_iter,
+    .read_iter = dev_read_iter,
+    .unlocked_ioctl = dev_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .uring_cmd = dev_uring_cmd,
+    .poll = dev_poll,
+    .splice_write = dev_splice_write,
+    .flush = dev_flush,
+    .release = dev_release,
+};
+
+/**
+ * Atributos sysfs em /sys/class/sevenseg/sevenseg/ (ou sevenseg<N>, um por
+ * display). Permitem atualizar o display
+ * com uma única syscall, sem open()/close() no /dev:
+ *
+ *   echo 1110111 > frame       - quadro binário, como no /dev/sevenseg (aceita poll())
+ *   echo OLA > text            - texto convertido em segmentos; se não couber no display, rola sozinho
+ *   echo 50 > brightness       - brilho de 0 a 100 (PWM em software)
+ *   echo 1 > seg0              - liga/desliga um único segmento do primeiro dígito
+ *
+ * A rolagem é configurada por scroll_speed_ms, scroll_pause_ms, scroll_loop e
+ * scroll_direction ("left" ou "right"). O atributo 'source' liga o display a
+ * uma fonte de dados do Kernel ("clock", "thermal:<zona>", "loadavg" ou "none"),
+ * lida a cada source_interval_ms
+ */
+static ssize_t frame_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    int len;
+
+    snapshot_frame(sd, frame);
+    len = frame_to_string(sd, frame, buf);
+    buf[len++] = '\n';
+    return len;
+}
+
+static ssize_t frame_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    stop_content_engines(sd);
+    apply_message(sd, buf, count);
+    return count;
+}
+static DEVICE_ATTR_RW(frame);
+
+static ssize_t text_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    char text[TEXT_MAX];
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->scroll_lock, flags);
+    strscpy(text, sd->scroll_text, sizeof(text));
+    spin_unlock_irqrestore(&sd->scroll_lock, flags);
+    return sysfs_emit(buf, "%s\n", text);
+}
+
+static ssize_t text_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    char text[TEXT_MAX];
+
+    strscpy(text, buf, min(count + 1, sizeof(text)));
+    text[strcspn(text, "\n")] = '\0';     // Remove o '\n' deixado pelo echo (espaços são mantidos, servem de margem na rolagem)
+    mutex_lock(&sd->text_lock);
+    stop_content_engines(sd);
+    show_text(sd, text);
+    mutex_unlock(&sd->text_lock);
+    return count;
+}
+static DEVICE_ATTR_RW(text);
+
+static ssize_t brightness_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(sd->brightness));
+}
+
+static ssize_t brightness_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    unsigned int value;
+    int ret = kstrtouint(buf, 0, &value);
+
+    if (ret) {
+        return ret;
+    }
+    set_brightness(sd, min_t(unsigned int, value, BRIGHTNESS_MAX));
+    return count;
+}
+static DEVICE_ATTR_RW(brightness);
+
+static ssize_t scroll_speed_ms_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(sd->scroll_speed_ms));
+}
+
+static ssize_t scroll_speed_ms_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    unsigned int value;
+    int ret = kstrtouint(buf, 0, &value);
+
+    if (ret) {
+        return ret;
+    }
+    WRITE_ONCE(sd->scroll_speed_ms, max(value, 1U));   // Vale a partir do próximo passo da rolagem
+    return count;
+}
+static DEVICE_ATTR_RW(scroll_speed_ms);
+
+static ssize_t scroll_pause_ms_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(sd->scroll_pause_ms));
+}
+
+static ssize_t scroll_pause_ms_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    unsigned int value;
+    int ret = kstrtouint(buf, 0, &value);
+
+    if (ret) {
+        return ret;
+    }
+    WRITE_ONCE(sd->scroll_pause_ms, value);
+    return count;
+}
+static DEVICE_ATTR_RW(scroll_pause_ms);
+
+static ssize_t scroll_loop_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(sd->scroll_loop));
+}
+
+static ssize_t scroll_loop_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    bool value;
+    int ret = kstrtobool(buf, &value);
+
+    if (ret) {
+        return ret;
+    }
+    WRITE_ONCE(sd->scroll_loop, value);
+    return count;
+}
+static DEVICE_ATTR_RW(scroll_loop);
+
+static ssize_t scroll_direction_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%s\n", READ_ONCE(sd->scroll_right) ? "right" : "left");
+}
+
+static ssize_t scroll_direction_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    if (sysfs_streq(buf, "left")) {
+        WRITE_ONCE(sd->scroll_right, false);
+    } else if (sysfs_streq(buf, "right")) {
+        WRITE_ONCE(sd->scroll_right, true);
+    } else {
+        return -EINVAL;
+    }
+    return count;
+}
+static DEVICE_ATTR_RW(scroll_direction);
+
+static ssize_t source_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    ssize_t len;
+
+    mutex_lock(&sd->source_lock);
+    switch (sd->source_kind) {
+    case SOURCE_CLOCK:
+        len = sysfs_emit(buf, "clock\n");
+        break;
+    case SOURCE_THERMAL:
+        len = sysfs_emit(buf, "thermal:%s\n", sd->source_tz_name);
+        break;
+    case SOURCE_LOADAVG:
+        len = sysfs_emit(buf, "loadavg\n");
+        break;
+    default:
+        len = sysfs_emit(buf, "none\n");
+        break;
+    }
+    mutex_unlock(&sd->source_lock);
+    return len;
+}
+
+static ssize_t source_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    int ret;
+
+    mutex_lock(&sd->text_lock);
+    stop_content_engines(sd);
+    ret = source_set(sd, buf);
+    mutex_unlock(&sd->text_lock);
+    return ret ? ret : count;
+}
+static DEVICE_ATTR_RW(source);
+
+static ssize_t source_interval_ms_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+
+    return sysfs_emit(buf, "%u\n", READ_ONCE(sd->source_interval_ms));
+}
+
+static ssize_t source_interval_ms_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    unsigned int value;
+    int ret = kstrtouint(buf, 0, &value);
+
+    if (ret) {
+        return ret;
+    }
+    mutex_lock(&sd->source_lock);
+    sd->source_interval_ms = max(value, 10U);
+    mutex_unlock(&sd->source_lock);
+    return count;
+}
+static DEVICE_ATTR_RW(source_interval_ms);
+
+/**
+ * Um atributo segN para cada segmento. O número do segmento fica guardado
+ * no campo 'var' do atributo estendido, então todos compartilham as mesmas funções
+ */
+static ssize_t seg_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    unsigned long segment = (unsigned long)container_of(attr, struct dev_ext_attribute, attr)->var;
+
+    return sysfs_emit(buf, "%d\n", !!(READ_ONCE(sd->framebuffer[0]) & BIT_ULL(segment)));
+}
+
+static ssize_t seg_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count) {
+    struct sevenseg_dev *sd = dev_get_drvdata(dev);
+    unsigned long segment = (unsigned long)container_of(attr, struct dev_ext_attribute, attr)->var;
+    u64 frame[SEVENSEG_MAX_DIGITS] = {0}, mask[SEVENSEG_MAX_DIGITS] = {0};
+    bool on;
+    int ret = kstrtobool(buf, &on);
+
+    if (ret) {
+        return ret;
+    }
+    stop_content_engines(sd);
+    mask[0] = BIT_ULL(segment);
+    frame[0] = on ? mask[0] : 0;
+    apply_frame(sd, frame, mask, NULL);
+    return count;
+}
+
+static const struct attribute_group seven_segment_group;
+
+/**
+ * Os atributos seg0, seg1... são montados na inicialização, um por linha
+ * configurada em 'pins', junto com a lista de grupos do display
+ */
+static void build_segment_attrs(struct sevenseg_dev *sd) {
+    for (int i = 0; i < sd->number_of_pins; i++) {
+        snprintf(sd->seg_attr_names[i], sizeof(sd->seg_attr_names[i]), "seg%d", i);
+        sysfs_attr_init(&sd->seg_attrs[i].attr.attr);
+        sd->seg_attrs[i].attr.attr.name = sd->seg_attr_names[i];
+        sd->seg_attrs[i].attr.attr.mode = 0644;
+        sd->seg_attrs[i].attr.show = seg_show;
+        sd->seg_attrs[i].attr.store = seg_store;
+        sd->seg_attrs[i].var = (void *)(unsigned long)i;
+        sd->seg_attr_list[i] = &sd->seg_attrs[i].attr.attr;
+    }
+    sd->seg_attr_list[sd->number_of_pins] = NULL;   // O configfs pode reduzir o número de linhas
+    sd->segment_group.attrs = sd->seg_attr_list;
+    sd->groups[0] = &seven_segment_group;
+    sd->groups[1] = &sd->segment_group;
+    sd->groups[2] = NULL;
+}
+
+static struct attribute *seven_segment_attrs[] = {
+    &dev_attr_frame.attr,
+    &dev_attr_text.attr,
+    &dev_attr_brightness.attr,
+    &dev_attr_scroll_speed_ms.attr,
+    &dev_attr_scroll_pause_ms.attr,
+    &dev_attr_scroll_loop.attr,
+    &dev_attr_scroll_direction.attr,
+    &dev_attr_source.attr,
+    &dev_attr_source_interval_ms.attr,
+    NULL,
+};
+
+static const struct attribute_group seven_segment_group = {
+    .attrs = seven_segment_attrs,
+};
+
+
+/**
+ * /sys/kernel/debug/sevenseg/stats: despertares por segundo e custo da
+ * varredura desde a carga do módulo. Escrever qualquer coisa zera a contagem
+ */
+static int stats_show(struct seq_file *m, void *v) {
+    struct sevenseg_dev *sd = m->private;
+    u64 wakeups = atomic64_read(&sd->stats.wakeups);
+    u64 calls, total_ns, max_ns, elapsed_ns, group_ticks = 0, group_ns = 1;
+    const char *group_chip = NULL;
+    unsigned int group_members = 0;
+    struct scan_group *g;
+    unsigned long flags;
+    bool refresh_idle;
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    g = sd->scan_group;
+    if (g) {
+        spin_lock(&g->lock);
+    }
+    calls = sd->stats.refresh_calls;
+    total_ns = sd->stats.refresh_ns;
+    max_ns = sd->stats.refresh_max_ns;
+    elapsed_ns = max(ktime_get_ns() - sd->stats.since_ns, 1ULL);
+    if (g) {
+        struct sevenseg_dev *member;
+
+        group_chip = g->chip->label;
+        list_for_each_entry(member, &g->members, scan_node) {
+            group_members++;
+        }
+        group_ticks = g->ticks;
+        group_ns = max(ktime_get_ns() - g->since_ns, 1ULL);
+        spin_unlock(&g->lock);
+    }
+    if (g) {
+        refresh_idle = test_bit(IDLE_REFRESH, &sd->idle_timers);
+    } else if (charlieplexed(sd)) {
+        refresh_idle = !sd->scan_task || test_bit(IDLE_REFRESH, &sd->idle_timers);
+    } else {
+        refresh_idle = true;                    // Sem varredura (ou sem os pinos)
+    }
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+
+    seq_printf(m, "wakeups: %llu\n", wakeups);
+    seq_printf(m, "wakeups_per_sec: %llu\n", mul_u64_u64_div_u64(wakeups, NSEC_PER_SEC, elapsed_ns));
+    seq_printf(m, "refresh_calls: %llu\n", calls);
+    seq_printf(m, "refresh_total_ns: %llu\n", total_ns);
+    seq_printf(m, "refresh_avg_ns: %llu\n", calls ? div64_u64(total_ns, calls) : 0);
+    seq_printf(m, "refresh_max_ns: %llu\n", max_ns);
+    seq_printf(m, "idle_entries: %lld\n", atomic64_read(&sd->stats.idle_entries));
+    seq_printf(m, "refresh_idle: %d\n", refresh_idle);
+    seq_printf(m, "pwm_idle: %d\n", !hrtimer_active(&sd->pwm_timer));
+    seq_printf(m, "pins_held: %d\n", READ_ONCE(sd->pins_held));
+    seq_printf(m, "pins_acquire_count: %llu\n", READ_ONCE(sd->stats.acquire_count));
+    seq_printf(m, "pins_acquire_last_ns: %llu\n", READ_ONCE(sd->stats.acquire_last_ns));
+    seq_printf(m, "pins_acquire_max_ns: %llu\n", READ_ONCE(sd->stats.acquire_max_ns));
+    if (group_chip) {
+        // Disparos do grupo inteiro: com vários membros, menos que a soma dos 'wakeups' de cada um
+        seq_printf(m, "scan_group: %s\n", group_chip);
+        seq_printf(m, "scan_group_members: %u\n", group_members);
+        seq_printf(m, "scan_group_wakeups: %llu\n", group_ticks);
+        seq_printf(m, "scan_group_wakeups_per_sec: %llu\n", mul_u64_u64_div_u64(group_ticks, NSEC_PER_SEC, group_ns));
+    }
+    return 0;
+}
+
+static int stats_open(struct inode *inode, struct file *file) {
+    return single_open(file, stats_show, inode->i_private);
+}
+
+static ssize_t stats_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    struct sevenseg_dev *sd = file_inode(file)->i_private;
+    struct scan_group *g;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    g = sd->scan_group;
+    if (g) {
+        spin_lock(&g->lock);
+    }
+    sd->stats.refresh_calls = 0;
+    sd->stats.refresh_ns = 0;
+    sd->stats.refresh_max_ns = 0;
+    sd->stats.since_ns = ktime_get_ns();
+    if (g) {
+        g->ticks = 0;                           // Zera também a contagem do grupo, compartilhada com os outros membros
+        g->since_ns = sd->stats.since_ns;
+        spin_unlock(&g->lock);
+    }
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+    atomic64_set(&sd->stats.wakeups, 0);
+    atomic64_set(&sd->stats.idle_entries, 0);
+    return count;
+}
+
+static const struct file_operations stats_fops = {
+    .owner = THIS_MODULE,
+    .open = stats_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .write = stats_write,
+    .release = single_release,
+};
+
+/**
+ * /sys/kernel/debug/sevenseg/bench: auto-benchmark para qualificar placas e
+ * controladores de GPIO. Uma thread do Kernel empurra quadros pelo caminho
+ * normal (apply_frame) o mais rápido possível, ou a uma taxa alvo, sem nenhuma
+ * syscall no meio da medida. Cada quadro inverte todas as linhas de segmento
+ *
+ *   echo 5000 > bench         - 5 s o mais rápido possível
+ *   echo "5000 1000" > bench  - 5 s a 1000 quadros/s
+ *   echo stop > bench         - interrompe
+ *   cat bench                 - quadros/s, percentis da latência de apply_frame e uso de CPU
+ *
+ * Os motores de conteúdo são parados antes; sem os pinos (lazy_pins) a medida
+ * cobre só o framebuffer
+ */
+#define BENCH_MAX_SAMPLES (1 << 20)         // Latências guardadas (os quadros seguintes só entram na contagem)
+
+
+static int bench_cmp(const void *a, const void *b) {
+    u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static u32 bench_percentile(u32 *sorted, u64 count, unsigned int per_mille) {
+    return count ? sorted[div_u64(count * per_mille, 1000) - (per_mille == 1000)] : 0;
+}
+
+static int bench_thread(void *data) {
+    struct sevenseg_dev *sd = data;
+    u64 frame[SEVENSEG_MAX_DIGITS];
+    u64 start, end, cpu_start, next;
+    u64 period_ns = sd->bench_rate_hz ? div_u64(NSEC_PER_SEC, sd->bench_rate_hz) : 0;
+    struct bench_result result = { .rate_hz = sd->bench_rate_hz, .pins_held = READ_ONCE(sd->pins_held) };
+    u64 pattern = 0x5555555555555555ULL;
+    u64 samples = 0;
+
+    cpu_start = current->se.sum_exec_runtime;
+    start = next = ktime_get_ns();
+    end = start + sd->bench_duration_ns;
+    while (!kthread_should_stop()) {
+        u64 before, now;
+
+        for (int d = 0; d < sd->number_of_digits; d++) {
+            frame[d] = pattern & all_segments(sd);
+        }
+        pattern = ~pattern;
+        before = ktime_get_ns();
+        apply_frame(sd, frame, NULL, NULL);
+        now = ktime_get_ns();
+        if (samples < BENCH_MAX_SAMPLES) {
+            sd->bench_samples[samples++] = min_t(u64, now - before, U32_MAX);
+        }
+        result.frames++;
+        if (now >= end) {
+            break;
+        }
+        if (period_ns) {
+            ktime_t expires;
+
+            next += period_ns;
+            expires = ns_to_ktime(next);
+            set_current_state(TASK_INTERRUPTIBLE);
+            schedule_hrtimeout_range_clock(&expires, 0, HRTIMER_MODE_ABS, CLOCK_MONOTONIC);
+        } else {
+            cond_resched();
+        }
+    }
+    result.elapsed_ns = ktime_get_ns() - start;
+    result.cpu_ns = current->se.sum_exec_runtime - cpu_start;
+
+    sort(sd->bench_samples, samples, sizeof(*sd->bench_samples), bench_cmp, NULL);
+    result.p50_ns = bench_percentile(sd->bench_samples, samples, 500);
+    result.p90_ns = bench_percentile(sd->bench_samples, samples, 900);
+    result.p99_ns = bench_percentile(sd->bench_samples, samples, 990);
+    result.p999_ns = bench_percentile(sd->bench_samples, samples, 999);
+    result.max_ns = bench_percentile(sd->bench_samples, samples, 1000);
+    sd->bench_result = result;
+    smp_store_release(&sd->bench_done, true);   // O resultado só é lido depois de ver bench_done
+
+    // Esperamos o kthread_stop() de quem nos criou, para que a task ainda exista quando ele vier
+    set_current_state(TASK_INTERRUPTIBLE);
+    while (!kthread_should_stop()) {
+        schedule();
+        set_current_state(TASK_INTERRUPTIBLE);
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+/**
+ * Encerra (ou recolhe, se já terminou) a medida em andamento. Chamada com bench_lock travado
+ */
+static void bench_reap(struct sevenseg_dev *sd) {
+    if (sd->bench_task) {
+        kthread_stop(sd->bench_task);
+        sd->bench_task = NULL;
+        vfree(sd->bench_samples);
+        sd->bench_samples = NULL;
+    }
+}
+
+static int bench_show(struct seq_file *m, void *v) {
+    struct sevenseg_dev *sd = m->private;
+    struct bench_result *r = &sd->bench_result;
+
+    mutex_lock(&sd->bench_lock);
+    if (sd->bench_task && !smp_load_acquire(&sd->bench_done)) {
+        seq_puts(m, "running: 1\n");
+        mutex_unlock(&sd->bench_lock);
+        return 0;
+    }
+    bench_reap(sd);
+    seq_printf(m, "frames: %llu\n", r->frames);
+    seq_printf(m, "elapsed_ns: %llu\n", r->elapsed_ns);
+    seq_printf(m, "target_rate_hz: %u\n", r->rate_hz);
+    seq_printf(m, "frames_per_sec: %llu\n", r->elapsed_ns ? mul_u64_u64_div_u64(r->frames, NSEC_PER_SEC, r->elapsed_ns) : 0);
+    seq_printf(m, "latency_p50_ns: %u\n", r->p50_ns);
+    seq_printf(m, "latency_p90_ns: %u\n", r->p90_ns);
+    seq_printf(m, "latency_p99_ns: %u\n", r->p99_ns);
+    seq_printf(m, "latency_p999_ns: %u\n", r->p999_ns);
+    seq_printf(m, "latency_max_ns: %u\n", r->max_ns);
+    seq_printf(m, "cpu_percent: %llu\n", r->elapsed_ns ? div64_u64(r->cpu_ns * 100, r->elapsed_ns) : 0);
+    seq_printf(m, "pins_held: %d\n", r->pins_held);
+    mutex_unlock(&sd->bench_lock);
+    return 0;
+}
+
+static int bench_open(struct inode *inode, struct file *file) {
+    return single_open(file, bench_show, inode->i_private);
+}
+
+static ssize_t bench_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos) {
+    struct sevenseg_dev *sd = file_inode(file)->i_private;
+    unsigned int duration_ms, rate_hz = 0;
+    char command[32];
+    int result = 0;
+
+    if (count >= sizeof(command) || copy_from_user(command, buf, count)) {
+        return -EINVAL;
+    }
+    command[count] = '\0';
+
+    mutex_lock(&sd->bench_lock);
+    bench_reap(sd);
+    if (!sysfs_streq(command, "stop")) {
+        if (sscanf(command, "%u %u", &duration_ms, &rate_hz) < 1 || duration_ms == 0) {
+            result = -EINVAL;
+            goto out;
+        }
+        sd->bench_samples = vmalloc(array_size(BENCH_MAX_SAMPLES, sizeof(*sd->bench_samples)));
+        if (!sd->bench_samples) {
+            result = -ENOMEM;
+            goto out;
+        }
+        stop_content_engines(sd);             // O benchmark é o único escritor durante a medida
+        memset(&sd->bench_result, 0, sizeof(sd->bench_result));
+        sd->bench_done = false;
+        sd->bench_duration_ns = (u64)duration_ms * NSEC_PER_MSEC;
+        sd->bench_rate_hz = rate_hz;
+        sd->bench_task = kthread_run(bench_thread, sd, "%s-bench", sd->name);
+        if (IS_ERR(sd->bench_task)) {
+            result = PTR_ERR(sd->bench_task);
+            sd->bench_task = NULL;
+            vfree(sd->bench_samples);
+            sd->bench_samples = NULL;
+        }
+    }
+out:
+    mutex_unlock(&sd->bench_lock);
+    return result ? result : count;
+}
+
+static const struct file_operations bench_fops = {
+    .owner = THIS_MODULE,
+    .open = bench_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .write = bench_write,
+    .release = single_release,
+};
+
+/**
+ * /sys/kernel/debug/sevenseg/history: os últimos HISTORY_RECORDS quadros
+ * aplicados, como uma sequência binária de struct sevenseg_history_record
+ * (do mais antigo ao mais novo; a leitura termina no quadro mais recente).
+ * Escrever a mesma sequência de volta reproduz os quadros com os intervalos
+ * originais, depois do close() (o cat pode dividir a escrita em vários pedaços):
+ *
+ *   cat /sys/kernel/debug/sevenseg/history > incidente.bin
+ *   cat incidente.bin > /sys/kernel/debug/sevenseg/history
+ */
+#define REPLAY_MAX_RECORDS 16384
+
+struct history_file {
+    struct sevenseg_dev *sd;                // Com uma referência: o release pode vir depois do debugfs removido
+    u64 next;                               // Próximo registro a ler
+    struct sevenseg_history_record *replay; // Registros recebidos para reproduzir
+    size_t replay_len;                      // Bytes recebidos
+    size_t replay_size;                     // Bytes alocados
+};
+
+static int history_open(struct inode *inode, struct file *filep) {
+    struct history_file *file = kzalloc(sizeof(*file), GFP_KERNEL);
+    struct sevenseg_dev *sd = inode->i_private;
+    u64 head = smp_load_acquire(&sd->history_head);
+
+    if (!file) {
+        return -ENOMEM;
+    }
+    kref_get(&sd->ref);
+    file->sd = sd;
+    file->next = head > HISTORY_RECORDS ? head - HISTORY_RECORDS : 0;
+    filep->private_data = file;
+    return nonseekable_open(inode, filep);
+}
+
+static ssize_t history_read(struct file *filep, char __user *buf, size_t count, loff_t *ppos) {
+    struct history_file *file = filep->private_data;
+    struct sevenseg_dev *sd = file->sd;
+    struct sevenseg_history_record record;
+    size_t copied = 0;
+
+    if (count < sizeof(record)) {
+        return -EINVAL;                     // Só entregamos registros inteiros
+    }
+    while (count - copied >= sizeof(record) && file->next < smp_load_acquire(&sd->history_head)) {
+        if (!history_fetch(sd, file->next, &record)) {
+            file->next = READ_ONCE(sd->history_reserved) - HISTORY_RECORDS;    // Ficamos para trás: pula para o mais antigo ainda válido
+            continue;
+        }
+        if (copy_to_user(buf + copied, &record, sizeof(record))) {
+            return copied ? copied : -EFAULT;
+        }
+        copied += sizeof(record);
+        file->next++;
+    }
+    return copied;
+}
+
+static ssize_t history_write(struct file *filep, const char __user *buf, size_t count, loff_t *ppos) {
+    struct history_file *file = filep->private_data;
+
+    if (file->replay_len + count > REPLAY_MAX_RECORDS * sizeof(*file->replay)) {
+        return -EFBIG;
+    }
+    if (file->replay_len + count > file->replay_size) {
+        size_t size = min(max(2 * file->replay_size, file->replay_len + count), REPLAY_MAX_RECORDS * sizeof(*file->replay));
+        void *grown = kvrealloc(file->replay, file->replay_size, size, GFP_KERNEL);
+
+        if (!grown) {
+            return -ENOMEM;
+        }
+        file->replay = grown;
+        file->replay_size = size;
+    }
+    if (copy_from_user((char *)file->replay + file->replay_len, buf, count)) {
+        return -EFAULT;
+    }
+    file->replay_len += count;
+    return count;
+}
+
+static int history_release(struct inode *inode, struct file *filep) {
+    struct history_file *file = filep->private_data;
+    struct sevenseg_dev *sd = file->sd;
+    u32 count = file->replay_len / sizeof(*file->replay);  // Um registro incompleto no final é ignorado
+
+    if (count) {
+        stop_content_engines(sd);             // A reprodução é o único escritor, como uma animação
+        replay_replace(sd, file->replay, count);
+    } else {
+        kvfree(file->replay);
+    }
+    kfree(file);
+    sevenseg_dev_put(sd);
+    return 0;
+}
+
+static const struct file_operations history_fops = {
+    .owner = THIS_MODULE,
+    .open = history_open,
+    .read = history_read,
+    .write = history_write,
+    .llseek = no_llseek,
+    .release = history_release,
+};
+
+#define GENL_FRAME_SIZE (nla_total_size(sizeof(u64) * SEVENSEG_MAX_DIGITS) + \
+                         2 * nla_total_size_64bit(sizeof(u64)) + 2 * nla_total_size(sizeof(u32)))
+
+static const struct nla_policy sevenseg_genl_policy[SEVENSEG_ATTR_MAX + 1] = {
+    [SEVENSEG_ATTR_SEGMENTS] = { .type = NLA_BINARY, .len = sizeof(u64) * SEVENSEG_MAX_DIGITS },
+    [SEVENSEG_ATTR_SEQ] = { .type = NLA_U64 },
+    [SEVENSEG_ATTR_LATCH_NS] = { .type = NLA_U64 },
+    [SEVENSEG_ATTR_PID] = { .type = NLA_U32 },
+    [SEVENSEG_ATTR_MINOR] = { .type = NLA_U32 },
+};
+
+static int genl_put_frame(struct sevenseg_dev *sd, struct sk_buff *msg, const u64 *segments, u64 seq, u64 latch_ns) {
+    if (nla_put(msg, SEVENSEG_ATTR_SEGMENTS, sd->number_of_digits * sizeof(u64), segments) ||
+        nla_put_u64_64bit(msg, SEVENSEG_ATTR_SEQ, seq, SEVENSEG_ATTR_PAD) ||
+        nla_put_u64_64bit(msg, SEVENSEG_ATTR_LATCH_NS, latch_ns, SEVENSEG_ATTR_PAD) ||
+        nla_put_u32(msg, SEVENSEG_ATTR_MINOR, sd->minor)) {
+        return -EMSGSIZE;
+    }
+    return 0;
+}
+
+/**
+ * Envia um registro do histórico para o grupo multicast
+ */
+static void genl_broadcast(struct sevenseg_dev *sd, const struct sevenseg_history_record *record) {
+    struct sk_buff *msg = genlmsg_new(GENL_FRAME_SIZE, GFP_KERNEL);
+    void *hdr;
+
+    if (!msg) {
+        return;
+    }
+    hdr = genlmsg_put(msg, 0, 0, &sevenseg_genl_family, 0, SEVENSEG_CMD_FRAME);
+    if (!hdr || genl_put_frame(sd, msg, record->segments, record->seq, record->latch_ns) ||
+        nla_put_u32(msg, SEVENSEG_ATTR_PID, record->pid)) {
+        nlmsg_free(msg);
+        return;
+    }
+    genlmsg_end(msg, hdr);
+    genlmsg_multicast(&sevenseg_genl_family, msg, 0, 0, GFP_KERNEL);
+}
+
+static void genl_work_fn(struct work_struct *work) {
+    struct sevenseg_dev *sd = container_of(work, struct sevenseg_dev, genl_work);
+    struct sevenseg_history_record record;
+    unsigned long flags;
+    u64 next, head;
+
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    next = sd->genl_next;
+    head = sd->genl_next = sd->history_head;
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+
+    if (head - next > HISTORY_RECORDS) {
+        next = head - HISTORY_RECORDS;      // Ficamos para trás: o salto no seq mostra aos ouvintes o que se perdeu
+    }
+    while (next < head) {
+        if (!history_fetch(sd, next, &record)) {
+            next = READ_ONCE(sd->history_reserved) - HISTORY_RECORDS;
+            continue;
+        }
+        genl_broadcast(sd, &record);
+        next++;
+    }
+}
+
+static int genl_reply_frame(struct sevenseg_dev *sd, struct genl_info *info, const struct sevenseg_frame *report) {
+    struct sk_buff *msg = genlmsg_new(GENL_FRAME_SIZE, GFP_KERNEL);
+    void *hdr;
+
+    if (!msg) {
+        return -ENOMEM;
+    }
+    hdr = genlmsg_put_reply(msg, info, &sevenseg_genl_family, 0, SEVENSEG_CMD_FRAME);
+    if (!hdr || genl_put_frame(sd, msg, report->segments, report->seq, report->latch_ns)) {
+        nlmsg_free(msg);
+        return -EMSGSIZE;
+    }
+    genlmsg_end(msg, hdr);
+    return genlmsg_reply(msg, info);
+}
+
+/**
+ * Display escolhido por MINOR (0, o /dev/sevenseg, quando ausente), com uma referência
+ */
+static struct sevenseg_dev *genl_dev(struct genl_info *info) {
+    struct nlattr *minor = info->attrs[SEVENSEG_ATTR_MINOR];
+    struct sevenseg_dev *sd;
+
+    mutex_lock(&sevenseg_minors_lock);
+    sd = idr_find(&sevenseg_minors, minor ? nla_get_u32(minor) : 0);
+    if (sd) {
+        kref_get(&sd->ref);
+    }
+    mutex_unlock(&sevenseg_minors_lock);
+    if (!sd) {
+        GENL_SET_ERR_MSG(info, "nenhum display com este minor");
+    }
+    return sd;
+}
+
+static int genl_get(struct sk_buff *skb, struct genl_info *info) {
+    struct sevenseg_dev *sd = genl_dev(info);
+    struct sevenseg_frame report;
+    unsigned long flags;
+    int ret;
+
+    if (!sd) {
+        return -ENODEV;
+    }
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    fill_report(sd, &report);
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+    ret = genl_reply_frame(sd, info, &report);
+    sevenseg_dev_put(sd);
+    return ret;
+}
+
+static int genl_set(struct sk_buff *skb, struct genl_info *info) {
+    struct nlattr *segments = info->attrs[SEVENSEG_ATTR_SEGMENTS];
+    u64 frame[SEVENSEG_MAX_DIGITS] = {0};
+    struct sevenseg_frame report;
+    struct sevenseg_dev *sd;
+    int ret;
+
+    if (!segments || nla_len(segments) % sizeof(u64)) {
+        GENL_SET_ERR_MSG(info, "SEGMENTS deve ser um vetor de __u64");
+        return -EINVAL;
+    }
+    sd = genl_dev(info);
+    if (!sd) {
+        return -ENODEV;
+    }
+    nla_memcpy(frame, segments, sizeof(frame));
+    stop_content_engines(sd);                 // Como qualquer escrita direta: vale o último quadro
+    apply_frame(sd, frame, NULL, &report);
+    ret = genl_reply_frame(sd, info, &report);
+    sevenseg_dev_put(sd);
+    return ret;
+}
+
+static const struct genl_small_ops sevenseg_genl_ops[] = {
+    {
+        .cmd = SEVENSEG_CMD_GET,
+        .doit = genl_get,
+    },
+    {
+        .cmd = SEVENSEG_CMD_SET,
+        .doit = genl_set,
+        .flags = GENL_ADMIN_PERM,
+    },
+};
+
+static const struct genl_multicast_group sevenseg_genl_mcgrps[] = {
+    { .name = SEVENSEG_GENL_MCGRP },
+};
+
+static struct genl_family sevenseg_genl_family = {
+    .name = SEVENSEG_GENL_NAME,
+    .version = SEVENSEG_GENL_VERSION,
+    .maxattr = SEVENSEG_ATTR_MAX,
+    .policy = sevenseg_genl_policy,
+    .module = THIS_MODULE,
+    .small_ops = sevenseg_genl_ops,
+    .n_small_ops = ARRAY_SIZE(sevenseg_genl_ops),
+    .resv_start_op = SEVENSEG_CMD_FRAME + 1,
+    .mcgrps = sevenseg_genl_mcgrps,
+    .n_mcgrps = ARRAY_SIZE(sevenseg_genl_mcgrps),
+};
+
+static void register_genl(void) {
+    if (genl_register_family(&sevenseg_genl_family)) {
+        printk(KERN_WARNING "sevenseg: falha ao registrar a familia generic netlink\n");
+        return;
+    }
+    WRITE_ONCE(genl_registered, true);
+}
 
 /**
- * Estruturas de dados utilizadas pelo Kernel para criar
- * um character device (chardev)
+ * Só no rmmod, depois que todos os displays saíram (cada um cancela o seu genl_work)
  */
-static int major_number;                            // Número major do dispositivo (ID utilizado pelo sistema)
-static struct class* seven_segment_class = NULL;    // Estrutura que representa a classe do dispositivo
-static struct device* seven_segment_device = NULL;  // Estrutura que representa o dispositivo
-static struct cdev seven_segment_cdev;              // Estrutura de caractere do dispositivo (cdev)
+static void unregister_genl(void) {
+    if (genl_registered) {
+        WRITE_ONCE(genl_registered, false);
+        genl_unregister_family(&sevenseg_genl_family);
+    }
+}
+
+static void bench_stop(struct sevenseg_dev *sd) {
+    mutex_lock(&sd->bench_lock);
+    bench_reap(sd);
+    mutex_unlock(&sd->bench_lock);
+}
 
 /**
- * Definição dos pinos GPIO conectados ao display de 7 segmentos.
- * Estes pinos GPIO foram selecionados aleatoriamente, lembre-se
- * que temos um barramento de 40 pinos configuráveis à nossa disposição
+ * Cada segmento também é registrado como um LED da classe LED do Kernel
+ * (/sys/class/leds/sevenseg::segN), então gatilhos já existentes como heartbeat,
+ * timer, disk-activity e netdev podem piscar segmentos sem nenhum processo no
+ * espaço do usuário. A escrita passa pelo framebuffer (primeiro dígito), então
+ * os LEDs convivem com o /dev/sevenseg e com os atributos sysfs
  */
-#define PIN_A 17
-#define PIN_B 18
-#define PIN_C 27
-#define PIN_D 22
-#define PIN_E 23
-#define PIN_F 24
-#define PIN_G 25
+
+static void segment_led_set(struct led_classdev *cdev, enum led_brightness value) {
+    struct sevenseg_led *led = container_of(cdev, struct sevenseg_led, cdev);
+    u64 frame[SEVENSEG_MAX_DIGITS] = {0}, mask[SEVENSEG_MAX_DIGITS] = {0};
+
+    mask[0] = BIT_ULL(led->segment);
+    frame[0] = value ? mask[0] : 0;
+    apply_frame(led->sd, frame, mask, NULL);    // Nunca dorme: os gatilhos chamam esta função a partir de temporizadores
+}
+
+static enum led_brightness segment_led_get(struct led_classdev *cdev) {
+    struct sevenseg_led *led = container_of(cdev, struct sevenseg_led, cdev);
+
+    return (READ_ONCE(led->sd->framebuffer[0]) & BIT_ULL(led->segment)) ? LED_ON : LED_OFF;
+}
+
+static void unregister_segment_leds(struct sevenseg_dev *sd) {
+    while (sd->number_of_leds > 0) {
+        led_classdev_unregister(&sd->segment_leds[--sd->number_of_leds].cdev);
+    }
+}
+
+static int register_segment_leds(struct sevenseg_dev *sd) {
+    int result;
+
+    for (int i = 0; i < sd->number_of_pins; i++) {
+        struct sevenseg_led *led = &sd->segment_leds[i];
+
+        snprintf(sd->segment_led_names[i], sizeof(sd->segment_led_names[i]), "%s::seg%d", sd->name, i);
+        led->sd = sd;
+        led->segment = i;
+        led->cdev.name = sd->segment_led_names[i];
+        led->cdev.max_brightness = LED_ON;
+        led->cdev.brightness_set = segment_led_set;
+        led->cdev.brightness_get = segment_led_get;
+        result = led_classdev_register(sd->device, &led->cdev);
+        if (result) {
+            unregister_segment_leds(sd);
+            return result;
+        }
+        sd->number_of_leds++;
+    }
+    return 0;
+}
 
 /**
- * Definição do tamanho máximo da nossa string binária, para este display temos
- * sete caracteres (um para cada segmento) + o terminador de string '\0', mas
- * poderemos atualizar este código futuramente para suportar outros tipos de display
+ * Estado inicial e remoção sem piscar. Por padrão o display começa apagado e
+ * é apagado de novo no rmmod. Com initial_frame, o quadro dado já é o valor
+ * com que cada pino vira saída (não há um instante apagado entre a carga e o
+ * primeiro quadro); com keep_on_exit, o rmmod solta os pinos sem mexer no
+ * nível deles (se o nível se mantém depois disso depende do controlador de
+ * GPIO; com varredura, fica aceso só o dígito da vez). Com async_probe, os
+ * pinos são configurados na hora e o resto do registro (chardev, sysfs, LEDs)
+ * roda em segundo plano, fora do caminho do boot
+ *
+ * Exemplo: sudo insmod sevenseg.ko initial_frame=0000001 keep_on_exit=1 async_probe=1
  */
-#define MAX_BUF_SIZE 8
+static char *initial_frame;
+module_param(initial_frame, charp, 0444);
+MODULE_PARM_DESC(initial_frame, "Quadro mostrado desde a carga do modulo, no formato do /dev/sevenseg");
+
+static bool keep_on_exit;
+module_param(keep_on_exit, bool, 0644);
+MODULE_PARM_DESC(keep_on_exit, "Mantem o ultimo quadro nos pinos ao remover o modulo");
+
+static bool async_probe;
+module_param(async_probe, bool, 0444);
+MODULE_PARM_DESC(async_probe, "Registra o chardev, o sysfs e os LEDs em segundo plano");
+
+static ASYNC_DOMAIN_EXCLUSIVE(sevenseg_async);  // Nosso domínio: o rmmod espera só pelo nosso registro em segundo plano
 
 /**
- * Aqui vamos criar um vetor com os números dos pinos selecionados
- * para automatizar a manipulação. Também fazemos um cálculo simples
- * para descobrir o tamanho do vetor automaticamente (a linguagem C
- * não possui um método simples para isso como outras linguagens).
- * Isso nos permitirá adicionar mais pinos ao vetor futuramente sem
- * nos preocuparmos em alterar muitas coisas no código
+ * Torna o display alcançável pelo minor (open(), generic netlink) e, no
+ * minor 0, por sevenseg_counter_add()
  */
-static unsigned int gpio_pins[] = {PIN_A, PIN_B, PIN_C, PIN_D, PIN_E, PIN_F, PIN_G};
-static int number_of_pins = sizeof(gpio_pins) / sizeof(gpio_pins[0]);   // Dividimos o tamanho do vetor inteiro pelo tamanho de 1 de seus elementos, ou seja, 7 / 1 = 7
+static void sevenseg_dev_publish(struct sevenseg_dev *sd) {
+    unsigned long flags;
+
+    mutex_lock(&sevenseg_minors_lock);
+    idr_replace(&sevenseg_minors, sd, sd->minor);
+    mutex_unlock(&sevenseg_minors_lock);
+    if (sd->minor == 0) {
+        spin_lock_irqsave(&primary_lock, flags);
+        primary_dev = sd;
+        spin_unlock_irqrestore(&primary_lock, flags);
+    }
+}
 
 /**
- * Função chamada quando o dispositivo é aberto
- * (quando vai trocar dados - lembrar do fopen() da linguagem C)
+ * O contrário de sevenseg_dev_publish(), antes de desligar o display. Falha
+ * se algum arquivo ainda estiver aberto; com 'defer' o desligamento fica então
+ * para o último close(). Sob sevenseg_minors_lock, como o open(), para nenhum
+ * open() entrar entre a verificação e o desligamento
  */
-static int dev_open(struct inode *inodep, struct file *filep) {
-    printk(KERN_INFO "sevenseg: character device aberto\n");
-    return 0; // Retorna 0 para indicar sucesso
+static bool sevenseg_dev_hide(struct sevenseg_dev *sd, bool defer) {
+    unsigned long flags;
+    bool busy;
+
+    async_synchronize_full_domain(&sevenseg_async); // Um registro em segundo plano ainda publicaria o display
+    mutex_lock(&sevenseg_minors_lock);
+    mutex_lock(&sd->pins_mutex);
+    busy = sd->pin_users > 0;
+    if (!busy) {
+        idr_replace(&sevenseg_minors, NULL, sd->minor);
+    }
+    sd->down_pending = busy && defer;
+    mutex_unlock(&sd->pins_mutex);
+    mutex_unlock(&sevenseg_minors_lock);
+    if (!busy && sd->minor == 0) {
+        spin_lock_irqsave(&primary_lock, flags);
+        primary_dev = NULL;
+        spin_unlock_irqrestore(&primary_lock, flags);
+    }
+    return !busy;
 }
 
 /**
- * Função chamada quando o dispositivo é fechado
- * (quando já terminou de trocar dados - lembrar do fclose() da linguagem C)
+ * Registra o chardev e o device (com os atributos sysfs) deste display, as
+ * estatísticas e os LEDs. A classe e a faixa de minors são do módulo, criadas
+ * no init. Em caso de erro desfaz o que já tinha feito
  */
-static int dev_release(struct inode *inodep, struct file *filep) {
-    printk(KERN_INFO "sevenseg: character device fechado\n");
-    return 0; // Retorna 0 para indicar sucesso
+static int seven_segment_register(struct sevenseg_dev *sd) {
+    dev_t dev = MKDEV(major_number, sd->minor);   // Major do módulo, minor deste display
+    int result;  // Variável para armazenar resultados de funções
+
+    // Criamos um dispositivo (ou "arquivo") localizado em /dev/sevenseg (ou /dev/sevenseg<minor>)
+    sd->device = device_create_with_groups(seven_segment_class, NULL, dev, sd, sd->groups, sd->name);
+    if (IS_ERR(sd->device)) {
+        printk(KERN_ALERT "sevenseg: falha ao criar o device %s\n", sd->name);
+        return PTR_ERR(sd->device);
+    }
+    printk(KERN_INFO "sevenseg: device %s criado corretamente\n", sd->name);
+    sd->frame_kn = sysfs_get_dirent(sd->device->kobj.sd, "frame");   // Guardamos o nó do atributo para notificar quem faz poll() nele
+
+    // Alocamos a estrutura cdev e adicionamos o dispositivo ao sistema. Ela tem vida própria: arquivos
+    // ainda abertos seguram o cdev mesmo depois do cdev_del()
+    sd->cdev = cdev_alloc();
+    result = sd->cdev ? 0 : -ENOMEM;
+    if (sd->cdev) {
+        sd->cdev->ops = &fops;
+        sd->cdev->owner = THIS_MODULE;
+        result = cdev_add(sd->cdev, dev, 1);
+        if (result < 0) {
+            kobject_put(&sd->cdev->kobj);
+        }
+    }
+    if (result < 0) {
+        sd->cdev = NULL;
+        sysfs_put(sd->frame_kn);
+        sd->frame_kn = NULL;
+        device_destroy(seven_segment_class, dev);
+        printk(KERN_ALERT "sevenseg: falha ao adicionar o cdev\n");
+        return result;
+    }
+
+    // Estatísticas no debugfs (opcional: falhas aqui não impedem o uso do display)
+    sd->debugfs_dir = debugfs_create_dir(sd->name, NULL);
+    debugfs_create_file("stats", 0644, sd->debugfs_dir, sd, &stats_fops);
+    debugfs_create_file("bench", 0644, sd->debugfs_dir, sd, &bench_fops);
+    debugfs_create_file("history", 0600, sd->debugfs_dir, sd, &history_fops);
+
+    // Registramos os segmentos como LEDs (opcional: sem eles o display continua funcionando normalmente)
+    if (register_segment_leds(sd)) {
+        printk(KERN_WARNING "sevenseg: falha ao registrar os segmentos como LEDs\n");
+    }
+
+    // Registramos na biblioteca line-display, se o Kernel tiver (opcional, como os LEDs)
+    register_linedisp(sd);
+
+    sd->registered = true;
+    sevenseg_dev_publish(sd);                   // A partir daqui o open() encontra o display
+    return 0;
+}
+
+static void seven_segment_unregister(struct sevenseg_dev *sd) {
+    dev_t dev = MKDEV(major_number, sd->minor); // Aqui utilizamos o major e o minor number (ID) para localizar e coletar as informações
+                                                // do nosso display que serão utilizadas durante a limpeza da nossa "bagunça"
+
+    unregister_linedisp(sd);                    // Removemos o line-display (e paramos a rolagem dele)
+    unregister_segment_leds(sd);                // Removemos os LEDs dos segmentos (e seus gatilhos)
+    debugfs_remove_recursive(sd->debugfs_dir);  // Removemos as estatísticas e o benchmark
+    sd->debugfs_dir = NULL;
+    bench_stop(sd);                             // Interrompemos uma medida em andamento
+    cdev_del(sd->cdev);                         // Removemos o dispositivo de caractere do Kernel
+    sd->cdev = NULL;
+    sysfs_put(sd->frame_kn);                    // Soltamos a referência ao atributo 'frame'
+    sd->frame_kn = NULL;
+    device_destroy(seven_segment_class, dev);   // Removemos o arquivo de /dev
+    sd->registered = false;
+}
+
+static void seven_segment_register_async(void *data, async_cookie_t cookie) {
+    struct sevenseg_dev *sd = data;
+
+    if (seven_segment_register(sd)) {
+        printk(KERN_ALERT "sevenseg: falha no registro em segundo plano, o display fica apenas com o quadro inicial\n");
+    }
 }
 
 /**
- * Função chamada quando o dispositivo recebe dados a partir
- * do espaço do usuário (lembrar do fwrite() da linguagem C)
+ * Valida a configuração dos pinos e recalcula tudo o que depende dela (número
+ * de dígitos, atributos segN, função da varredura e o buffer da frente).
+ * Chamada com o display desligado: nenhum pino conosco e nenhum registro
  */
-static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset) {
-    char message[MAX_BUF_SIZE] = {0}; // String para armazenar a mensagem binária recebida do usuário (7 caracteres + '\0')
+static int configure_layout(struct sevenseg_dev *sd) {
+    unsigned long flags;
+
+    if (sd->number_of_pins < 1 || (sd->segment_type != 7 && sd->segment_type != 14 && sd->segment_type != 16)) {
+        printk(KERN_ALERT "sevenseg: configure de 1 a %d pinos e segment_type 7, 14 ou 16\n", SEVENSEG_MAX_LINES);
+        return -EINVAL;
+    }
+    sd->number_of_digits = max(sd->number_of_digit_pins, 1);
+    if (charlieplexed(sd)) {
+        int leds = sd->number_of_charlie_pins * (sd->number_of_charlie_pins - 1);
 
-    // Verificamos se há dados para serem escritos ou não baseado no tamanho do buffer recebido do userspace
-    if (len > 0) {
-        if (copy_from_user(message, buffer, len < MAX_BUF_SIZE ? len : MAX_BUF_SIZE - 1)) {           // Função que copia os dados do espaço do usuário para o Kernel (de buffer -> message)
-            printk(KERN_ERR "sevenseg: falha na recepcao de dados\n");      // Aqui estamos truncando o tamanho da string recebida em no máximo 7 caracteres - proteção contra buffer overflow
-            return -EFAULT;                                                 // Retorna erro se a cópia falhar
+        if (multiplexed(sd)) {
+            printk(KERN_ALERT "sevenseg: charlie_pins nao pode ser usado com digit_pins\n");
+            return -EINVAL;
         }
-        for (int i = 0; i < number_of_pins && message[i] != '\0'; i++) {    // Vamos ler a string 'message' vinda do espaco do usuário caractere por caractere até encontrar o null terminator
-            gpio_set_value(gpio_pins[i], message[i] == '1');                // Se o caractere lido for '1' (char, e nao int), a condição resultará em TRUE, que equivale ao número 1 na linguagem C
-        }                                                                   // Esta forma serve apenas para evitar um if/else extenso, o que tornaria o código mais difícil de ler :)
-        printk(KERN_INFO "sevenseg: recebeu %zu caracteres do usuario\n", len);
+        if (leds < sd->number_of_pins) {        // N pinos acendem N * (N - 1) LEDs: é preciso caber ao menos um dígito
+            printk(KERN_ALERT "sevenseg: %d charlie_pins acendem %d LEDs, menos que os %d segmentos de um digito\n",
+                   sd->number_of_charlie_pins, leds, sd->number_of_pins);
+            return -EINVAL;
+        }
+        sd->number_of_digits = min(leds / sd->number_of_pins, SEVENSEG_MAX_DIGITS);
     }
-    return len; // Retorna o número de bytes escritos (obrigatório)
+    sd->refresh_hz = max(sd->refresh_hz, 1U);
+    build_segment_attrs(sd);
+
+    // O buffer da frente pode ter um plano de varredura do layout anterior
+    spin_lock_irqsave(&sd->frame_lock, flags);
+    tb_publish(sd);
+    spin_unlock_irqrestore(&sd->frame_lock, flags);
+    spin_lock_irqsave(&sd->pins_lock, flags);
+    tb_latch(sd);
+    sd->scan_digit = 0;
+    spin_unlock_irqrestore(&sd->pins_lock, flags);
+    return 0;
 }
 
+
 /**
- * Função chamada quando os dados registrados no dispositivo são lidos
- * e enviados para o espaço do usuário (lembrar do fread() da linguagem C)
+ * Liga o display já configurado: pede os pinos (exceto com lazy_pins) e
+ * registra o chardev, o sysfs e os LEDs. Chamada com instance_mutex travado
  */
-static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset) {
-    char segment_states[MAX_BUF_SIZE]; // String para armazenar os estados dos pinos GPIO (referentes a cada segmento do display)
-    int error_count;
+static int display_up(struct sevenseg_dev *sd, bool async) {
+    int result;
 
-    // Se já leu o arquivo uma vez durante esta chamada, retorna 0 para indicar que não há mais dados a serem lidos
-    if (*offset > 0) {
-        return 0;
+    if (!lazy_pins) {
+        mutex_lock(&sd->pins_mutex);
+        result = acquire_pins(sd);
+        mutex_unlock(&sd->pins_mutex);
+        if (result) {
+            return result;
+        }
+    }
+
+    if (async) {
+        async_schedule_domain(seven_segment_register_async, sd, &sevenseg_async);
+    } else {
+        result = seven_segment_register(sd);
+        if (result) {
+            mutex_lock(&sd->pins_mutex);
+            if (sd->pins_held) {
+                drop_pins(sd, false);
+            }
+            mutex_unlock(&sd->pins_mutex);
+            return result;
+        }
+    }
+    sd->display_enabled = true;
+    return 0;
+}
+
+/**
+ * Desliga o display: remove o registro, para os motores e devolve os pinos.
+ * Com 'keep', o último quadro fica nos pinos. Chamada com instance_mutex
+ * travado, depois de sevenseg_dev_hide()
+ */
+static void display_down(struct sevenseg_dev *sd, bool keep) {
+    if (sd->registered) {
+        seven_segment_unregister(sd);
+    }
+    stop_content_engines(sd);                     // Paramos a rolagem de texto e as animações, caso estejam rodando
+    cancel_delayed_work_sync(&sd->pins_release_work);
+
+    // Paramos a varredura e o PWM e devolvemos os pinos (se estiverem conosco)
+    mutex_lock(&sd->pins_mutex);
+    if (sd->pins_held) {
+        drop_pins(sd, keep);
+        if (keep) {
+            printk(KERN_INFO "sevenseg: mantendo o ultimo quadro nos pinos\n");
+        }
+    }
+    mutex_unlock(&sd->pins_mutex);
+    sd->display_enabled = false;
+}
+
+/**
+ * Configuração em tempo de execução pelo configfs, sem editar #defines nem
+ * recarregar o módulo:
+ *
+ *   mkdir /sys/kernel/config/sevenseg/painel
+ *   echo 17,18,27,22,23,24,25 > painel/pins
+ *   echo 5,6,13,19 > painel/digit_pins
+ *   cat painel/device                 - nome do device: sevenseg3 = /dev/sevenseg3
+ *   echo 1 > painel/enable            - pede os pinos e cria o /dev
+ *   echo 0 > painel/enable            - desliga (recusado enquanto o /dev estiver aberto)
+ *   rmdir painel                      - remove a instância e desliga (no último close(), se estiver aberto)
+ *
+ * Cada mkdir cria um display independente (struct sevenseg_dev), com o seu
+ * próprio minor, começando com a configuração dos parâmetros do módulo. O
+ * primeiro minor livre é usado: o display criado na carga (sem configfs_only)
+ * fica com o 0, /dev/sevenseg, e não aparece no configfs. Os atributos
+ * 'backend' e 'digits' são calculados a partir das listas de pinos
+ */
+static bool configfs_only;
+module_param(configfs_only, bool, 0444);
+MODULE_PARM_DESC(configfs_only, "Nao cria o display na carga; ele e criado pelo configfs");
+
+static bool configfs_registered;
+
+/**
+ * Lê uma lista de GPIOs separados por vírgula ("17,18,27"); uma linha vazia
+ * limpa a lista
+ */
+static int parse_pin_list(const char *page, unsigned int *pins, int max, int *count) {
+    unsigned int parsed[SEVENSEG_MAX_LINES];
+    char *copy, *cursor, *token;
+    int n = 0, result = 0;
+
+    copy = kstrndup(page, PAGE_SIZE, GFP_KERNEL);
+    if (!copy) {
+        return -ENOMEM;
+    }
+    cursor = strim(copy);
+    while (*cursor && (token = strsep(&cursor, ",")) != NULL) {
+        if (n == max || kstrtouint(strim(token), 0, &parsed[n])) {
+            result = -EINVAL;
+            break;
+        }
+        n++;
+    }
+    kfree(copy);
+    if (!result) {
+        memcpy(pins, parsed, n * sizeof(*pins));
+        *count = n;
+    }
+    return result;
+}
+
+static ssize_t show_pin_list(char *page, const unsigned int *pins, int count) {
+    ssize_t len = 0;
+
+    for (int i = 0; i < count; i++) {
+        len += sysfs_emit_at(page, len, "%s%u", i ? "," : "", pins[i]);
+    }
+    return len + sysfs_emit_at(page, len, "\n");
+}
+
+/**
+ * Atributos que mudam a configuração só podem ser escritos com o display desligado
+ */
+static ssize_t store_pin_list(struct sevenseg_dev *sd, const char *page, size_t len, unsigned int *pins, int max, int *count) {
+    int result;
+
+    mutex_lock(&sd->instance_mutex);
+    result = sd->display_enabled ? -EBUSY : parse_pin_list(page, pins, max, count);
+    mutex_unlock(&sd->instance_mutex);
+    return result ? result : len;
+}
+
+static inline struct sevenseg_dev *to_sevenseg_dev(struct config_item *item) {
+    return container_of(item, struct sevenseg_dev, item);
+}
+
+static ssize_t sevenseg_item_pins_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return show_pin_list(page, sd->gpio_pins, sd->number_of_pins);
+}
+
+static ssize_t sevenseg_item_pins_store(struct config_item *item, const char *page, size_t len) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return store_pin_list(sd, page, len, sd->gpio_pins, SEVENSEG_MAX_LINES, &sd->number_of_pins);
+}
+
+static ssize_t sevenseg_item_digit_pins_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return show_pin_list(page, sd->digit_pins, sd->number_of_digit_pins);
+}
+
+static ssize_t sevenseg_item_digit_pins_store(struct config_item *item, const char *page, size_t len) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return store_pin_list(sd, page, len, sd->digit_pins, SEVENSEG_MAX_DIGITS, &sd->number_of_digit_pins);
+}
+
+static ssize_t sevenseg_item_charlie_pins_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return show_pin_list(page, sd->charlie_pins, sd->number_of_charlie_pins);
+}
+
+static ssize_t sevenseg_item_charlie_pins_store(struct config_item *item, const char *page, size_t len) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return store_pin_list(sd, page, len, sd->charlie_pins, CHARLIE_MAX_PINS, &sd->number_of_charlie_pins);
+}
+
+static ssize_t sevenseg_item_segment_type_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return sysfs_emit(page, "%u\n", sd->segment_type);
+}
+
+static ssize_t sevenseg_item_segment_type_store(struct config_item *item, const char *page, size_t len) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+    unsigned int value;
+    int result;
+
+    if (kstrtouint(page, 10, &value)) {
+        return -EINVAL;
+    }
+    mutex_lock(&sd->instance_mutex);
+    result = sd->display_enabled ? -EBUSY : 0;
+    if (!result) {
+        sd->segment_type = value;           // Validado no enable
+    }
+    mutex_unlock(&sd->instance_mutex);
+    return result ? result : len;
+}
+
+static ssize_t sevenseg_item_refresh_hz_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return sysfs_emit(page, "%u\n", sd->refresh_hz);
+}
+
+static ssize_t sevenseg_item_refresh_hz_store(struct config_item *item, const char *page, size_t len) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+    unsigned int value;
+    int result;
+
+    if (kstrtouint(page, 10, &value) || value == 0) {
+        return -EINVAL;
+    }
+    mutex_lock(&sd->instance_mutex);
+    result = sd->display_enabled ? -EBUSY : 0;
+    if (!result) {
+        sd->refresh_hz = value;
+    }
+    mutex_unlock(&sd->instance_mutex);
+    return result ? result : len;
+}
+
+static ssize_t sevenseg_item_backend_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return sysfs_emit(page, "%s\n", charlieplexed(sd) ? "charlieplexed" : multiplexed(sd) ? "multiplexed" : "direct");
+}
+
+static ssize_t sevenseg_item_digits_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+    int digits = max(sd->number_of_digit_pins, 1);
+
+    if (charlieplexed(sd) && sd->number_of_pins > 0) {
+        digits = min(sd->number_of_charlie_pins * (sd->number_of_charlie_pins - 1) / sd->number_of_pins, SEVENSEG_MAX_DIGITS);
+    }
+    return sysfs_emit(page, "%d\n", digits);
+}
+
+static ssize_t sevenseg_item_device_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return sysfs_emit(page, "%s\n", sd->name);
+}
+
+static ssize_t sevenseg_item_enable_show(struct config_item *item, char *page) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    return sysfs_emit(page, "%d\n", READ_ONCE(sd->display_enabled));
+}
+
+static ssize_t sevenseg_item_enable_store(struct config_item *item, const char *page, size_t len) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+    bool enable;
+    int result = 0;
+
+    if (kstrtobool(page, &enable)) {
+        return -EINVAL;
     }
+    mutex_lock(&sd->instance_mutex);
+    if (enable && !sd->display_enabled) {
+        result = configure_layout(sd);
+        if (!result) {
+            result = display_up(sd, false);
+        }
+    } else if (!enable && sd->display_enabled) {
+        // Arquivos abertos continuariam escrevendo em um display que não existe mais
+        result = sevenseg_dev_hide(sd, false) ? 0 : -EBUSY;
+        if (!result) {
+            display_down(sd, false);
+        }
+    }
+    mutex_unlock(&sd->instance_mutex);
+    return result ? result : len;
+}
+
+CONFIGFS_ATTR(sevenseg_item_, pins);
+CONFIGFS_ATTR(sevenseg_item_, digit_pins);
+CONFIGFS_ATTR(sevenseg_item_, charlie_pins);
+CONFIGFS_ATTR(sevenseg_item_, segment_type);
+CONFIGFS_ATTR(sevenseg_item_, refresh_hz);
+CONFIGFS_ATTR_RO(sevenseg_item_, backend);
+CONFIGFS_ATTR_RO(sevenseg_item_, digits);
+CONFIGFS_ATTR_RO(sevenseg_item_, device);
+CONFIGFS_ATTR(sevenseg_item_, enable);
+
+static struct configfs_attribute *sevenseg_item_attrs[] = {
+    &sevenseg_item_attr_pins,
+    &sevenseg_item_attr_digit_pins,
+    &sevenseg_item_attr_charlie_pins,
+    &sevenseg_item_attr_segment_type,
+    &sevenseg_item_attr_refresh_hz,
+    &sevenseg_item_attr_backend,
+    &sevenseg_item_attr_digits,
+    &sevenseg_item_attr_device,
+    &sevenseg_item_attr_enable,
+    NULL,
+};
+
+static void sevenseg_item_release(struct config_item *item) {
+    sevenseg_dev_put(to_sevenseg_dev(item));
+}
+
+static struct configfs_item_operations sevenseg_item_ops = {
+    .release = sevenseg_item_release,
+};
+
+static const struct config_item_type sevenseg_item_type = {
+    .ct_item_ops = &sevenseg_item_ops,
+    .ct_attrs = sevenseg_item_attrs,
+    .ct_owner = THIS_MODULE,
+};
+
+static void instance_down_fn(struct work_struct *work) {
+    struct sevenseg_dev *sd = container_of(work, struct sevenseg_dev, instance_down_work);
 
-    for (int i = 0; i < number_of_pins; i++) {                          // Vamos coletar os estados atuais de cada pino GPIO (0 ou 1 em int)
-        segment_states[i] = gpio_get_value(gpio_pins[i]) ? '1' : '0';   // e montar uma string binária adicionando '0' e '1' na forma de char
+    mutex_lock(&sd->instance_mutex);
+    if (sd->down_pending && sevenseg_dev_hide(sd, true)) {  // Alguém pode ter aberto o arquivo de novo antes do trabalho rodar
+        display_down(sd, false);
     }
-    segment_states[number_of_pins] = '\0';                              // Temos que adicionar o terminador de string (null terminator)
+    mutex_unlock(&sd->instance_mutex);
+    sevenseg_dev_put(sd);                       // Referência tomada em pins_put()
+}
+
+/**
+ * Cria um display desligado, com a configuração dos parâmetros do módulo e o
+ * primeiro minor livre (ainda sem apontar para ele: o open() só o encontra
+ * depois de registrado)
+ */
+static struct sevenseg_dev *sevenseg_dev_create(void) {
+    struct sevenseg_dev *sd = kvzalloc(sizeof(*sd), GFP_KERNEL);
 
-    // Copia a string binária com o estado dos segmentos de volta para o espaço do usuário (de segment_states -> buffer)
-    error_count = copy_to_user(buffer, segment_states, number_of_pins + 1);
+    if (!sd) {
+        return ERR_PTR(-ENOMEM);
+    }
+    sd->history = kvcalloc(HISTORY_RECORDS, sizeof(*sd->history), GFP_KERNEL);
+    if (!sd->history) {
+        kvfree(sd);
+        return ERR_PTR(-ENOMEM);
+    }
+    mutex_lock(&sevenseg_minors_lock);
+    sd->minor = idr_alloc(&sevenseg_minors, NULL, 0, SEVENSEG_MAX_DEVICES, GFP_KERNEL);
+    mutex_unlock(&sevenseg_minors_lock);
+    if (sd->minor < 0) {
+        int result = sd->minor;
 
-    // Verifica se a cópia foi bem-sucedida
-    if (error_count == 0) {
-        printk(KERN_INFO "sevenseg: enviou %d caracteres para o usuario\n", number_of_pins);
-        *offset += number_of_pins + 1; // Atualiza o offset para evitar leituras repetidas (lembrar do fseek() da linguagem C)
-        return number_of_pins + 1;     // Retorna o número de bytes lidos (obrigatório)
+        kvfree(sd->history);
+        kvfree(sd);
+        return ERR_PTR(result == -ENOSPC ? -EBUSY : result);
+    }
+    kref_init(&sd->ref);
+    if (sd->minor == 0) {
+        strscpy(sd->name, DEVICE_NAME, sizeof(sd->name));
     } else {
-        printk(KERN_INFO "sevenseg: falha no envio de dados\n", error_count);
-        return -EFAULT; // Retorna erro se a cópia falhar
+        snprintf(sd->name, sizeof(sd->name), DEVICE_NAME "%d", sd->minor);
+    }
+
+    memcpy(sd->gpio_pins, param_pins, sizeof(sd->gpio_pins));
+    sd->number_of_pins = param_number_of_pins;
+    sd->segment_type = param_segment_type;
+    memcpy(sd->digit_pins, param_digit_pins, sizeof(sd->digit_pins));
+    sd->number_of_digit_pins = param_number_of_digit_pins;
+    sd->refresh_hz = param_refresh_hz;
+    memcpy(sd->charlie_pins, param_charlie_pins, sizeof(sd->charlie_pins));
+    sd->number_of_charlie_pins = param_number_of_charlie_pins;
+    sd->number_of_digits = 1;
+
+    spin_lock_init(&sd->frame_lock);
+    init_waitqueue_head(&sd->frame_wq);
+    INIT_LIST_HEAD(&sd->change_waiters);
+    INIT_LIST_HEAD(&sd->timed_waiters);
+    sd->tb_back = 0;
+    sd->tb_pending = 1;
+    sd->tb_front = 2;
+    spin_lock_init(&sd->pins_lock);
+    sd->brightness = BRIGHTNESS_MAX;
+    sd->pwm_phase_on = true;
+    mutex_init(&sd->text_lock);
+    spin_lock_init(&sd->scroll_lock);
+    sd->scroll_speed_ms = 300;
+    sd->scroll_pause_ms = 1000;
+    sd->scroll_loop = true;
+    spin_lock_init(&sd->anim_lock);
+    spin_lock_init(&sd->replay_lock);
+    mutex_init(&sd->source_lock);
+    sd->source_kind = SOURCE_NONE;
+    sd->source_interval_ms = 1000;
+    mutex_init(&sd->counter_lock);
+    mutex_init(&sd->pins_mutex);
+    mutex_init(&sd->instance_mutex);
+    mutex_init(&sd->bench_lock);
+
+    hrtimer_init(&sd->pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);   // Temporizador do PWM de brilho (só é armado com brilho intermediário)
+    sd->pwm_timer.function = pwm_tick;
+    hrtimer_init(&sd->scroll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);    // Temporizador da rolagem de texto
+    sd->scroll_timer.function = scroll_tick;
+    hrtimer_init(&sd->anim_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);      // Temporizador das animações
+    sd->anim_timer.function = anim_tick;
+    hrtimer_init(&sd->replay_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);    // Reprodução do histórico (instantes absolutos)
+    sd->replay_timer.function = replay_tick;
+    INIT_DEFERRABLE_WORK(&sd->source_work, source_work_fn);                 // Leitura periódica das fontes de dados
+    INIT_DELAYED_WORK(&sd->pins_release_work, pins_release_fn);             // Devolução dos pinos depois do último close() (lazy_pins)
+    INIT_WORK(&sd->genl_work, genl_work_fn);                                // Publicação dos quadros no generic netlink
+    INIT_WORK(&sd->instance_down_work, instance_down_fn);                   // Desligamento adiado de uma instância removida (configfs)
+    hrtimer_init(&sd->counter_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);   // Redesenho agrupado do modo contador
+    sd->counter_timer.function = counter_tick;
+    sd->stats.since_ns = ktime_get_ns();
+    return sd;
+}
+
+static struct config_item *sevenseg_make_item(struct config_group *group, const char *name) {
+    struct sevenseg_dev *sd = sevenseg_dev_create();
+
+    if (IS_ERR(sd)) {
+        return ERR_CAST(sd);
     }
+    config_item_init_type_name(&sd->item, name, &sevenseg_item_type);
+    return &sd->item;
 }
 
 /**
- * Estrutura obrigatória que define as operações de arquivo do dispositivo (open, read, write, release)
+ * O rmdir não pode falhar. Se o /dev da instância ainda estiver aberto, o
+ * display continua ligado e só é desligado no último close() (instance_down_fn());
+ * o minor só fica livre para outra instância depois disso
  */
-static struct file_operations fops = {
-    .open = dev_open,
-    .write = dev_write,
-    .read = dev_read,
-    .release = dev_release,
+static void sevenseg_drop_item(struct config_group *group, struct config_item *item) {
+    struct sevenseg_dev *sd = to_sevenseg_dev(item);
+
+    mutex_lock(&sd->instance_mutex);
+    if (sd->display_enabled) {
+        if (sevenseg_dev_hide(sd, true)) {
+            display_down(sd, false);
+        } else {
+            printk(KERN_WARNING "sevenseg: instancia %s removida com o dispositivo aberto, desligando no ultimo close()\n",
+                   sd->name);
+        }
+    }
+    mutex_unlock(&sd->instance_mutex);
+    config_item_put(item);
+}
+
+static struct configfs_group_operations sevenseg_group_ops = {
+    .make_item = sevenseg_make_item,
+    .drop_item = sevenseg_drop_item,
+};
+
+static const struct config_item_type sevenseg_subsys_type = {
+    .ct_group_ops = &sevenseg_group_ops,
+    .ct_owner = THIS_MODULE,
+};
+
+static struct configfs_subsystem sevenseg_subsys = {
+    .su_group = {
+        .cg_item = {
+            .ci_namebuf = DEVICE_NAME,
+            .ci_type = &sevenseg_subsys_type,
+        },
+    },
 };
 
+static struct sevenseg_dev *module_display;    // Display criado na carga (sem configfs_only)
+
 /**
  * Função chamada na inicialização do módulo (quando o módulo
  * é carregado através do comando insmod no Terminal)
  */
 static int __init seven_segment_init(void) {
+    struct sevenseg_dev *sd;
     int result;  // Variável para armazenar resultados de funções
     dev_t dev;   // Estrutura que armazena o major e minor number do dispositivo
 
     printk(KERN_INFO "sevenseg: inicializando o LKM para o display de 7 segmentos\n");
 
-    // Solicita ao Kernel e configura os pinos GPIO como saídas (referente a cada segmento do display)
-    for (int i = 0; i < number_of_pins; i++) {
-        if (gpio_request(gpio_pins[i], "sysfs")) {  // Solicita a permissão para utilizar o pino GPIO
-            printk(KERN_ALERT "sevenseg: falha na requisicao do pino GPIO %d\n", gpio_pins[i]);
-
-            for (int j = 0; j < i; j++) {
-                gpio_free(gpio_pins[j]);            // Libera os GPIOs já solicitados em caso de falha
-            }
-            return -1;                              // Retorna erro
-        }
-        gpio_direction_output(gpio_pins[i], 0);     // Configura o pino como saída e define o estado inicial como baixo (0)
-        gpio_export(gpio_pins[i], false);           // Exporta para o sistema sysfs do Linux, permitindo o acesso pelo usuário
-    }
-
-    // Alocamos um major number dinâmico para o dispositivo de caractere (ID obrigatório para que o Kernel identifique o driver)
-    result = alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME);
+    // Alocamos um major number dinâmico, com um minor por display (ID obrigatório para que o Kernel identifique o driver)
+    result = alloc_chrdev_region(&dev, 0, SEVENSEG_MAX_DEVICES, DEVICE_NAME);
     if (result < 0) {
         printk(KERN_ALERT "sevenseg: falha ao registrar um major number\n");
         return result;
@@ -172,35 +4728,76 @@ static int __init seven_segment_init(void) {
     // Criamos uma classe de dispositivo no Kernel para facilitar a criação e o gerenciamento do dispositivo (obrigatório)
     seven_segment_class = class_create(THIS_MODULE, CLASS_NAME);
     if (IS_ERR(seven_segment_class)) {
-        unregister_chrdev_region(dev, 1);
+        result = PTR_ERR(seven_segment_class);
         printk(KERN_ALERT "sevenseg: falha ao registrar classe do device\n");
-        return PTR_ERR(seven_segment_class);
+        goto err_region;
     }
     printk(KERN_INFO "sevenseg: registrada corretamente a classe do device\n");
 
-    // Criamos um dispositivo (ou "arquivo") localizado em /dev/sevenseg
-    seven_segment_device = device_create(seven_segment_class, NULL, dev, NULL, DEVICE_NAME);
-    if (IS_ERR(seven_segment_device)) {
-        class_destroy(seven_segment_class);
-        unregister_chrdev_region(dev, 1);
-        printk(KERN_ALERT "sevenseg: falha ao criar o device\n");
-        return PTR_ERR(seven_segment_device);
+    sevenseg_wq = alloc_workqueue("sevenseg", 0, 0);
+    if (!sevenseg_wq) {
+        result = -ENOMEM;
+        goto err_class;
     }
-    printk(KERN_INFO "sevenseg: device criado corretamente\n");
 
-    // Inicializamos a estrutura cdev e adicionamos o dispositivo ao sistema
-    cdev_init(&seven_segment_cdev, &fops);
-    seven_segment_cdev.owner = THIS_MODULE;
-    result = cdev_add(&seven_segment_cdev, dev, 1);
-    if (result < 0) {
-        device_destroy(seven_segment_class, dev);
-        class_destroy(seven_segment_class);
-        unregister_chrdev_region(dev, 1);
-        printk(KERN_ALERT "sevenseg: falha ao adicionar o cdev\n");
-        return result;
+    // Família generic netlink para quem acompanha os displays (opcional)
+    register_genl();
+
+    if (!configfs_only) {
+        sd = sevenseg_dev_create();             // Primeiro minor: /dev/sevenseg
+        if (IS_ERR(sd)) {
+            result = PTR_ERR(sd);
+            goto err_genl;
+        }
+        result = configure_layout(sd);
+        if (result) {
+            sevenseg_dev_put(sd);
+            goto err_genl;
+        }
+
+        // Quadro inicial: vai para o framebuffer e direto para o buffer da frente (ainda não há concorrência)
+        if (initial_frame) {
+            u64 mask[SEVENSEG_MAX_DIGITS] = {0};
+
+            parse_message(sd, initial_frame, strlen(initial_frame), sd->framebuffer, mask);
+            tb_publish(sd);
+            tb_latch(sd);
+        }
+
+        // Com async_probe o display já funciona; /dev/sevenseg aparece assim que o registro terminar
+        mutex_lock(&sd->instance_mutex);
+        result = display_up(sd, async_probe);
+        mutex_unlock(&sd->instance_mutex);
+        if (result) {
+            sevenseg_dev_put(sd);
+            goto err_genl;
+        }
+        module_display = sd;
+    }
+
+    // Diretório do configfs (opcional, a não ser que seja o único jeito de criar o display)
+    config_group_init(&sevenseg_subsys.su_group);
+    mutex_init(&sevenseg_subsys.su_mutex);
+    result = configfs_register_subsystem(&sevenseg_subsys);
+    if (result) {
+        printk(KERN_WARNING "sevenseg: falha ao registrar no configfs\n");
+        if (configfs_only) {
+            goto err_genl;
+        }
+    } else {
+        configfs_registered = true;
     }
 
     return 0; // Sucesso na inicialização do módulo
+
+err_genl:
+    unregister_genl();
+    destroy_workqueue(sevenseg_wq);
+err_class:
+    class_destroy(seven_segment_class);
+err_region:
+    unregister_chrdev_region(dev, SEVENSEG_MAX_DEVICES);
+    return result;
 }
 
 /**
@@ -213,21 +4810,24 @@ static int __init seven_segment_init(void) {
  * passo seja esquecido e cause problemas com gerenciamento de memória!!!
  */
 static void __exit seven_segment_exit(void) {
-    dev_t dev = MKDEV(major_number, 0);         // Aqui utilizamos o major number (ID) para localizar e coletar as informações
-                                                // do nosso driver que serão utilizadas durante a limpeza da nossa "bagunça"
-
-    cdev_del(&seven_segment_cdev);              // Removemos o dispositivo de caractere do Kernel
-    device_destroy(seven_segment_class, dev);   // Removemos o arquivo de /dev
-    class_unregister(seven_segment_class);      // Desregistramos a classe do dispositivo
-    class_destroy(seven_segment_class);         // Destruímos a classe do dispositivo
-    unregister_chrdev_region(dev, 1);           // Liberamos o major number para que outros dispositivos possam utilizar
+    struct sevenseg_dev *sd = module_display;
 
-    // Liberamos e desconfiguramos os pinos GPIO usados
-    for (int i = 0; i < number_of_pins; i++) {
-        gpio_set_value(gpio_pins[i], 0);        // Desligamos os pinos (nível lógico baixo)
-        gpio_unexport(gpio_pins[i]);            // Removemos do sistema sysfs do Linux
-        gpio_free(gpio_pins[i]);                // Retornamos o controle do GPIO para o Kernel
+    if (configfs_registered) {
+        configfs_unregister_subsystem(&sevenseg_subsys);    // Sem instâncias: o mkdir segura uma referência ao módulo
+    }
+    destroy_workqueue(sevenseg_wq);             // Esperamos os desligamentos adiados (os arquivos já foram fechados)
+    if (sd) {
+        mutex_lock(&sd->instance_mutex);
+        if (sd->display_enabled && sevenseg_dev_hide(sd, false)) {  // Sem arquivos abertos: eles seguram o módulo
+            display_down(sd, keep_on_exit);
+        }
+        mutex_unlock(&sd->instance_mutex);
+        sevenseg_dev_put(sd);
     }
+    unregister_genl();                          // Removemos a família netlink
+    class_destroy(seven_segment_class);         // Destruímos a classe do dispositivo
+    unregister_chrdev_region(MKDEV(major_number, 0), SEVENSEG_MAX_DEVICES); // Liberamos o major number para que outros dispositivos possam utilizar
+    idr_destroy(&sevenseg_minors);
 
     printk(KERN_INFO "sevenseg: encerrando...\n");
 }
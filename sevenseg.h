@@ -0,0 +1,202 @@
+/**
+ * Interface (UAPI) compartilhada entre o driver sevenseg e os programas
+ * do espaço do usuário. Este arquivo é incluído tanto pelo módulo do Kernel
+ * quanto pelas aplicações, por isso usamos apenas os tipos de <linux/types.h>
+ * (__u64, __u32...), que possuem o mesmo tamanho nos dois lados
+ */
+#ifndef _UAPI_SEVENSEG_H
+#define _UAPI_SEVENSEG_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * Número máximo de dígitos que um quadro pode descrever. Cada dígito é um
+ * bitmap de linhas (bit 0 = segmento A, bit 1 = segmento B, ...) com até
+ * SEVENSEG_MAX_LINES linhas: 7 segmentos, ponto decimal, 14 ou 16 segmentos
+ * ou uma coluna de matriz de pontos, conforme o parâmetro 'pins' do módulo
+ */
+#define SEVENSEG_MAX_DIGITS 8
+#define SEVENSEG_MAX_LINES 64
+
+/**
+ * Quadro completo do display. Nas operações de escrita apenas 'segments' é
+ * lido; nas respostas o driver preenche também o número de sequência do
+ * quadro e o instante (CLOCK_MONOTONIC, em ns) em que ele foi publicado. Sem
+ * multiplexação esse é o instante em que ele chegou aos pinos; em displays
+ * multiplexados ou charlieplexed ele aparece no início da próxima varredura
+ * (até um período de varredura depois), e com lazy_pins e os pinos devolvidos
+ * só no próximo open()
+ */
+struct sevenseg_frame {
+    __u64 segments[SEVENSEG_MAX_DIGITS];
+    __u64 seq;
+    __u64 latch_ns;
+};
+
+/**
+ * Quadro a ser aplicado em um instante absoluto de CLOCK_MONOTONIC (em ns).
+ * A resposta (seq e latch_ns) é escrita de volta no campo 'frame'
+ */
+struct sevenseg_timed_frame {
+    struct sevenseg_frame frame;
+    __u64 when_ns;
+};
+
+/**
+ * Programa de animação tocado pelo próprio driver, sem nenhum processo no
+ * espaço do usuário: uma sequência de passos (quadro + duração) repetida
+ * 'repeat' vezes (0 = para sempre). Ao terminar, o último quadro fica no display
+ */
+#define SEVENSEG_ANIM_MAX_STEPS 4096
+
+struct sevenseg_anim_step {
+    __u64 segments[SEVENSEG_MAX_DIGITS];
+    __u32 duration_ms;
+    __u32 reserved;
+};
+
+struct sevenseg_anim {
+    __u64 steps;        // Endereço do vetor de struct sevenseg_anim_step
+    __u32 count;        // Número de passos (1 a SEVENSEG_ANIM_MAX_STEPS)
+    __u32 repeat;       // Quantas vezes tocar a sequência (0 = para sempre)
+};
+
+/**
+ * Modo contador: cada sinal do eventfd 'fd' soma o seu valor ao contador
+ * exibido, começando em 'value'. Com fd = -1 o contador só é alimentado
+ * por outros módulos do Kernel (sevenseg_counter_add())
+ */
+struct sevenseg_counter {
+    __s32 fd;
+    __u32 reserved;
+    __u64 value;
+};
+
+/**
+ * Quadro agendado sem espera (SCHEDULE): aplicado no instante absoluto
+ * 'when_ns' do relógio 'clockid' (CLOCK_MONOTONIC ou CLOCK_TAI). Cada arquivo
+ * aberto tem até SEVENSEG_SCHEDULE_MAX quadros agendados e relatórios não lidos
+ */
+#define SEVENSEG_SCHEDULE_MAX 64
+
+struct sevenseg_schedule {
+    struct sevenseg_frame frame;    // Apenas 'segments' é lido
+    __u64 when_ns;
+    __u64 cookie;                   // Valor livre, devolvido no relatório
+    __u32 clockid;
+    __u32 reserved;                 // Deve ser 0
+};
+
+/**
+ * Relatório de apresentação de um quadro agendado (PRESENT). 'latch_ns' é o
+ * instante de publicação (como em struct sevenseg_frame), no mesmo relógio do
+ * pedido; 'lateness_ns' = latch_ns - target_ns
+ */
+struct sevenseg_present {
+    __u64 cookie;
+    __u64 seq;
+    __u64 target_ns;
+    __u64 latch_ns;
+    __s64 lateness_ns;
+    __u32 clockid;
+    __u32 reserved;
+};
+
+/**
+ * Registro do histórico de quadros aplicados (/sys/kernel/debug/sevenseg/history).
+ * A leitura devolve uma sequência destes registros, do mais antigo ao mais novo;
+ * a mesma sequência escrita de volta no arquivo é reproduzida com os mesmos
+ * intervalos entre os quadros. 'pid' é o processo que escreveu (0 = o próprio
+ * Kernel: temporizadores, motores de conteúdo, LEDs, threads do Kernel)
+ */
+struct sevenseg_history_record {
+    __u64 segments[SEVENSEG_MAX_DIGITS];
+    __u64 seq;
+    __u64 latch_ns;                 // Instante de publicação, CLOCK_MONOTONIC
+    __s32 pid;
+    __u32 reserved;
+};
+
+/**
+ * Comandos ioctl do /dev/sevenseg:
+ *
+ * GET_FRAME    - lê o quadro atual
+ * SET_FRAME    - aplica um quadro imediatamente
+ * SET_FRAME_AT - aplica um quadro no instante 'when_ns' (retorna depois de aplicado)
+ * WAIT_CHANGE  - espera até que o número de sequência seja diferente de 'seq'
+ *                e devolve o novo quadro
+ * ANIM_LOAD    - carrega e começa a tocar uma animação (substitui a atual)
+ * ANIM_STOP    - para a animação atual
+ * COUNTER      - liga o modo contador (qualquer quadro escrito depois o desliga)
+ * SCHEDULE     - agenda um quadro e retorna na hora
+ * PRESENT      - lê o próximo relatório de quadro agendado; poll() indica
+ *                EPOLLPRI quando há relatórios (com O_NONBLOCK, -EAGAIN se vazio)
+ */
+#define SEVENSEG_IOC_MAGIC 'S'
+#define SEVENSEG_IOC_GET_FRAME    _IOR(SEVENSEG_IOC_MAGIC, 0x00, struct sevenseg_frame)
+#define SEVENSEG_IOC_SET_FRAME    _IOWR(SEVENSEG_IOC_MAGIC, 0x01, struct sevenseg_frame)
+#define SEVENSEG_IOC_SET_FRAME_AT _IOWR(SEVENSEG_IOC_MAGIC, 0x02, struct sevenseg_timed_frame)
+#define SEVENSEG_IOC_WAIT_CHANGE  _IOWR(SEVENSEG_IOC_MAGIC, 0x03, struct sevenseg_frame)
+#define SEVENSEG_IOC_ANIM_LOAD    _IOW(SEVENSEG_IOC_MAGIC, 0x04, struct sevenseg_anim)
+#define SEVENSEG_IOC_ANIM_STOP    _IO(SEVENSEG_IOC_MAGIC, 0x05)
+#define SEVENSEG_IOC_COUNTER      _IOW(SEVENSEG_IOC_MAGIC, 0x06, struct sevenseg_counter)
+#define SEVENSEG_IOC_SCHEDULE     _IOW(SEVENSEG_IOC_MAGIC, 0x07, struct sevenseg_schedule)
+#define SEVENSEG_IOC_PRESENT      _IOR(SEVENSEG_IOC_MAGIC, 0x08, struct sevenseg_present)
+
+/**
+ * Os mesmos comandos podem ser enviados de forma assíncrona pelo io_uring
+ * (IORING_OP_URING_CMD): 'cmd_op' recebe o número do ioctl e a área 'cmd' da
+ * SQE carrega esta estrutura, com o endereço do mesmo argumento do ioctl.
+ * A CQE só é gerada quando a operação termina (quadro aplicado ou mudança vista)
+ */
+struct sevenseg_uring_cmd {
+    __u64 addr;
+};
+
+/**
+ * Família generic netlink "sevenseg": cada quadro aplicado é publicado no grupo
+ * multicast "frames" (comando FRAME), então qualquer número de ouvintes
+ * acompanha o display sem abrir o /dev/sevenseg. Pela mesma família:
+ *
+ * GET - responde com o quadro atual (comando FRAME)
+ * SET - aplica SEGMENTS (requer CAP_NET_ADMIN) e responde com o quadro aplicado
+ *
+ * SEGMENTS é um vetor de __u64, um bitmap por dígito (como em struct sevenseg_frame).
+ * Todo FRAME traz o MINOR do display; GET e SET escolhem o display por MINOR
+ * (sem ele, o /dev/sevenseg)
+ */
+#define SEVENSEG_GENL_NAME      "sevenseg"
+#define SEVENSEG_GENL_VERSION   1
+#define SEVENSEG_GENL_MCGRP     "frames"
+
+enum {
+    SEVENSEG_CMD_UNSPEC,
+    SEVENSEG_CMD_GET,
+    SEVENSEG_CMD_SET,
+    SEVENSEG_CMD_FRAME,
+    __SEVENSEG_CMD_MAX,
+};
+#define SEVENSEG_CMD_MAX (__SEVENSEG_CMD_MAX - 1)
+
+enum {
+    SEVENSEG_ATTR_UNSPEC,
+    SEVENSEG_ATTR_SEGMENTS,     // binário: __u64 por dígito
+    SEVENSEG_ATTR_SEQ,          // __u64
+    SEVENSEG_ATTR_LATCH_NS,     // __u64, CLOCK_MONOTONIC
+    SEVENSEG_ATTR_PID,          // __u32, processo que escreveu (0 = Kernel)
+    SEVENSEG_ATTR_PAD,
+    SEVENSEG_ATTR_MINOR,        // __u32, display (0 = /dev/sevenseg, N = /dev/sevensegN)
+    __SEVENSEG_ATTR_MAX,
+};
+#define SEVENSEG_ATTR_MAX (__SEVENSEG_ATTR_MAX - 1)
+
+#ifdef __KERNEL__
+/**
+ * Para outros módulos do Kernel: soma 'n' ao contador exibido (modo contador)
+ * no /dev/sevenseg
+ */
+void sevenseg_counter_add(u64 n);
+#endif
+
+#endif /* _UAPI_SEVENSEG_H */
@@ -0,0 +1,105 @@
+#!/bin/sh
+# Benchmark da varredura compartilhada em função do número de displays
+# Autor: Lucas Barboza
+#
+# Cria um controlador gpio-sim com linhas para MAX_DISPLAYS displays multiplexados
+# (DIGITS dígitos de SEGMENTS segmentos cada), carrega o sevenseg com configfs_only=1
+# e mede, com 1, 2, 4, ... MAX_DISPLAYS displays no mesmo controlador, o custo
+# total da varredura: disparos por segundo de todos os grupos e tempo gasto neles
+# (soma de refresh_total_ns de todos os displays, em % de uma CPU). Cada contagem
+# é medida com a varredura compartilhada (shared_scan=1: um disparo e três
+# set_multiple para todos os displays que vencem juntos) e com um grupo por
+# display (shared_scan=0). Precisa de root, configfs, debugfs e gpio-sim
+# (CONFIG_GPIO_SIM). As linhas do gpio-sim dormem, então os disparos rodam na
+# thread do grupo (sevenseg-<controlador>)
+#
+# Kernels anteriores ao 6.2 numeram no máximo 512 GPIOs: reduza MAX_DISPLAYS,
+# DIGITS ou SEGMENTS se o gpio-sim não conseguir registrar o controlador
+#
+# Uso (rodar da pasta do projeto, depois do make):
+#   sudo [MAX_DISPLAYS=64] [DIGITS=4] [SEGMENTS=7] tools/bench-refresh.sh [segundos por medida]
+
+set -e
+
+DURATION=${1:-5}
+MODULE=./sevenseg.ko
+MAX_DISPLAYS=${MAX_DISPLAYS:-64}
+DIGITS=${DIGITS:-4}
+SEGMENTS=${SEGMENTS:-7}
+SIM=/sys/kernel/config/gpio-sim/sevenseg-bench
+CONFIG=/sys/kernel/config/sevenseg
+PER_DISPLAY=$((DIGITS + SEGMENTS))
+
+cleanup() {
+    for item in $CONFIG/bench*; do
+        [ -d "$item" ] && echo 0 > "$item/enable" 2>/dev/null; rmdir "$item" 2>/dev/null || true
+    done
+    rmmod sevenseg 2>/dev/null || true
+    if [ -d $SIM ]; then
+        echo 0 > $SIM/live 2>/dev/null || true
+        rmdir $SIM/bank0 $SIM 2>/dev/null || true
+    fi
+}
+trap cleanup EXIT
+
+modprobe gpio-sim 2>/dev/null || true
+mkdir $SIM $SIM/bank0
+echo $((MAX_DISPLAYS * PER_DISPLAY)) > $SIM/bank0/num_lines
+echo 1 > $SIM/live
+CHIP=$(cat $SIM/bank0/chip_name)
+BASE=$(sed -n "s/^$CHIP: GPIOs \([0-9]*\)-.*/\1/p" /sys/kernel/debug/gpio)
+if [ -z "$BASE" ]; then
+    echo "nao achei a numeracao de $CHIP em /sys/kernel/debug/gpio" >&2
+    exit 1
+fi
+
+lines() {   # lines <primeira> <quantidade>: lista de GPIOs consecutivos
+    seq -s, $1 $(($1 + $2 - 1))
+}
+
+# Todos os segmentos acesos em todos os dígitos: a varredura nunca para
+digit=$(printf "%${SEGMENTS}s" | tr ' ' 1)
+frame=$(for d in $(seq $DIGITS); do printf "%s " $digit; done)
+
+printf "%8s %7s %14s %14s %8s\n" displays shared wakeups/s busy_ns/s cpu%
+displays=1
+while [ $displays -le $MAX_DISPLAYS ]; do
+    for shared in 1 0; do
+        insmod $MODULE configfs_only=1 refresh_hz=250 shared_scan=$shared
+        names=""
+        for i in $(seq 0 $((displays - 1))); do
+            first=$((BASE + i * PER_DISPLAY))
+            mkdir $CONFIG/bench$i
+            echo $(lines $first $SEGMENTS) > $CONFIG/bench$i/pins
+            echo $(lines $((first + SEGMENTS)) $DIGITS) > $CONFIG/bench$i/digit_pins
+            echo 1 > $CONFIG/bench$i/enable
+            name=$(cat $CONFIG/bench$i/device)
+            echo "$frame" > /sys/class/sevenseg/$name/frame
+            names="$names $name"
+        done
+        for name in $names; do
+            echo > /sys/kernel/debug/$name/stats
+        done
+        sleep "$DURATION"
+
+        # Cada grupo aparece em todos os seus membros: wakeups/membros soma cada grupo uma vez
+        for name in $names; do
+            cat /sys/kernel/debug/$name/stats
+            echo
+        done | awk -v seconds="$DURATION" -v displays=$displays -v shared=$shared '
+            /^refresh_total_ns:/ { busy += $2 }
+            /^scan_group_members:/ { members = $2 }
+            /^scan_group_wakeups_per_sec:/ { wakeups += $2 / members }
+            END {
+                printf "%8d %7d %14d %14d %8.2f\n", displays, shared, wakeups, busy / seconds,
+                       busy / seconds / 1e7
+            }'
+
+        for i in $(seq 0 $((displays - 1))); do
+            echo 0 > $CONFIG/bench$i/enable
+            rmdir $CONFIG/bench$i
+        done
+        rmmod sevenseg
+    done
+    displays=$((displays * 2))
+done
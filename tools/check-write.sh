@@ -0,0 +1,56 @@
+#!/bin/sh
+# Verificação da escrita de vários quadros em um único write()
+# Autor: Lucas Barboza
+#
+# Escreve três linhas em /dev/sevenseg com uma única chamada write() e confere no
+# histórico (/sys/kernel/debug/sevenseg/history) que as três foram aplicadas, e no
+# próprio dispositivo que a última ficou no display. Precisa do módulo carregado
+# (qualquer layout), root e debugfs
+#
+# Uso: sudo tools/check-write.sh
+
+set -e
+
+DEVICE=/dev/sevenseg
+HISTORY=/sys/kernel/debug/sevenseg/history
+RECORD=88                               # sizeof(struct sevenseg_history_record)
+TMP=$(mktemp)
+trap 'rm -f $TMP' EXIT
+
+last_seq() {                            # Campo 'seq' (deslocamento 64) do registro mais recente
+    cat $HISTORY > $TMP.hist
+    n=$(($(wc -c < $TMP.hist) / RECORD))
+    if [ $n -eq 0 ]; then
+        echo 0
+    else
+        od -An -tu8 -j $(((n - 1) * RECORD + 64)) -N8 $TMP.hist | tr -d ' '
+    fi
+    rm -f $TMP.hist
+}
+
+# Uma linha por quadro, com o tamanho do display atual: a linha k acende só o segmento k de cada dígito
+current=$(tr -d '\0' < $DEVICE)
+lines=$(echo "$current" | cut -d' ' -f1 | tr -d '\n' | wc -c)
+digits=$(echo "$current" | wc -w)
+frame() {                               # frame <segmento>
+    digit=$(i=0; while [ $i -lt $lines ]; do [ $i -eq $1 ] && printf 1 || printf 0; i=$((i + 1)); done)
+    d=0; while [ $d -lt $digits ]; do [ $d -gt 0 ] && printf ' '; printf %s $digit; d=$((d + 1)); done
+    printf '\n'
+}
+{ frame 0; frame 1; frame 2; } > $TMP
+last=$(tail -n 1 $TMP)
+
+before=$(last_seq)
+dd if=$TMP of=$DEVICE bs=4096 count=1 2>/dev/null    # Um único write() com as três linhas
+after=$(last_seq)
+shown=$(tr -d '\0' < $DEVICE)
+
+if [ $((after - before)) -ne 3 ]; then
+    echo "FALHOU: $((after - before)) quadro(s) aplicado(s), esperados 3" >&2
+    exit 1
+fi
+if [ "$shown" != "$last" ]; then
+    echo "FALHOU: display mostra '$shown', esperado '$last'" >&2
+    exit 1
+fi
+echo "OK: 3 quadros aplicados por um unico write()"
@@ -0,0 +1,561 @@
+/**
+ * sevenseg-cuse: implementação em espaço do usuário do /dev/sevenseg, para máquinas
+ * que não podem carregar módulos de fora da árvore do Kernel ou que nem têm GPIO (CI).
+ * O dispositivo é servido pelo CUSE (character device in userspace, do FUSE) com a
+ * mesma ABI do driver: quadros em texto no read()/write() e os ioctls GET_FRAME,
+ * SET_FRAME, SET_FRAME_AT e WAIT_CHANGE de sevenseg.h. Os demais ioctls (animações,
+ * contador, agendamento) respondem ENOTTY
+ *
+ * Sem --chip o display existe só em memória (mock). Com --chip, as linhas são
+ * pedidas pela uAPI v2 de GPIO (/dev/gpiochipN) e cada atualização é um único
+ * GPIO_V2_LINE_SET_VALUES cobrindo todas as linhas. Com --digit-pins, uma thread
+ * faz a varredura dos dígitos a --refresh-hz, como o temporizador do driver
+ *
+ * Com --bench, em vez de servir o dispositivo, roda o mesmo auto-benchmark do
+ * /sys/kernel/debug/sevenseg/bench (mesmo relatório), para comparar os dois caminhos
+ *
+ * Compilação (da pasta do projeto):
+ *   gcc -O2 -Wall -I. -o sevenseg-cuse tools/sevenseg-cuse.c $(pkg-config --cflags --libs fuse3) -lpthread
+ *
+ * Uso:
+ *   sudo ./sevenseg-cuse -f                                             (mock)
+ *   sudo ./sevenseg-cuse -f --chip=/dev/gpiochip0 --pins=17,18,27,22,23,24,25
+ *   sudo ./sevenseg-cuse -f --chip=/dev/gpiochip0 --pins=... --digit-pins=5,6,13,19 --refresh-hz=100
+ *   ./sevenseg-cuse --bench=5000 [--chip=... --pins=...]                (5 s o mais rápido possível)
+ *   ./sevenseg-cuse --bench=5000,1000                                   (5 s a 1000 quadros/s)
+ */
+#define FUSE_USE_VERSION 31
+#define _GNU_SOURCE
+
+#include <cuse_lowlevel.h>
+#include <fuse_opt.h>
+#include <linux/gpio.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sevenseg.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+#define BENCH_MAX_SAMPLES (1 << 20)
+
+/**
+ * Opções da linha de comando (as demais vão para o CUSE, como -f e -d)
+ */
+static struct options {
+    char *name;             // Nome do dispositivo em /dev
+    char *chip;             // /dev/gpiochipN (sem ele, mock)
+    char *pins;             // Offsets das linhas de segmento no chip
+    char *digit_pins;       // Offsets das linhas de seleção dos dígitos
+    unsigned int refresh_hz;
+    char *bench;            // "duração_ms[,taxa_hz]"
+} options = {
+    .name = "sevenseg",
+    .pins = "0,1,2,3,4,5,6",
+    .refresh_hz = 100,
+};
+
+#define OPTION(t, p) { t, offsetof(struct options, p), 1 }
+static const struct fuse_opt option_spec[] = {
+    OPTION("--name=%s", name),
+    OPTION("--chip=%s", chip),
+    OPTION("--pins=%s", pins),
+    OPTION("--digit-pins=%s", digit_pins),
+    OPTION("--refresh-hz=%u", refresh_hz),
+    OPTION("--bench=%s", bench),
+    FUSE_OPT_END
+};
+
+/**
+ * Estado do display, o equivalente ao framebuffer do driver
+ */
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_changed = PTHREAD_COND_INITIALIZER;   // Quem espera em WAIT_CHANGE
+static __u64 framebuffer[SEVENSEG_MAX_DIGITS];
+static __u64 frame_seq;
+static __u64 frame_latch_ns;
+
+static unsigned int segment_lines[SEVENSEG_MAX_LINES];
+static int number_of_pins;
+static unsigned int digit_lines[SEVENSEG_MAX_DIGITS];
+static int number_of_digit_pins;
+static int number_of_digits = 1;
+static int line_fd = -1;                    // Requisição de linhas da uAPI v2 (-1 = mock)
+
+static __u64 now_ns(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static __u64 all_segments(void) {
+    return number_of_pins == 64 ? ~0ULL : (1ULL << number_of_pins) - 1;
+}
+
+/**
+ * Lê uma lista de números separados por vírgula
+ */
+static int parse_list(const char *text, unsigned int *values, int max) {
+    char *copy = strdup(text), *cursor = copy, *token;
+    int n = 0;
+
+    while ((token = strsep(&cursor, ",")) != NULL && *token) {
+        if (n == max) {
+            n = -1;
+            break;
+        }
+        values[n++] = strtoul(token, NULL, 0);
+    }
+    free(copy);
+    return n;
+}
+
+/**
+ * Escreve nas linhas marcadas em 'mask' (bit i = linha i da requisição) com uma única ioctl
+ */
+static void write_lines(__u64 bits, __u64 mask) {
+    struct gpio_v2_line_values values = { .bits = bits, .mask = mask };
+
+    if (line_fd >= 0 && ioctl(line_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+        perror("sevenseg-cuse: GPIO_V2_LINE_SET_VALUES");
+    }
+}
+
+/**
+ * Pede as linhas de segmento e de dígito como saídas apagadas
+ */
+static int request_lines(void) {
+    struct gpio_v2_line_request request;
+    int chip;
+
+    if (number_of_pins + number_of_digit_pins > GPIO_V2_LINES_MAX) {
+        fprintf(stderr, "sevenseg-cuse: no maximo %d linhas por requisicao\n", GPIO_V2_LINES_MAX);
+        return -1;
+    }
+    chip = open(options.chip, O_RDWR | O_CLOEXEC);
+    if (chip < 0) {
+        perror(options.chip);
+        return -1;
+    }
+    memset(&request, 0, sizeof(request));
+    memcpy(request.offsets, segment_lines, number_of_pins * sizeof(segment_lines[0]));
+    memcpy(request.offsets + number_of_pins, digit_lines, number_of_digit_pins * sizeof(digit_lines[0]));
+    strcpy(request.consumer, "sevenseg-cuse");
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    request.num_lines = number_of_pins + number_of_digit_pins;
+    if (ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+        perror("sevenseg-cuse: GPIO_V2_GET_LINE_IOCTL");
+        close(chip);
+        return -1;
+    }
+    close(chip);
+    line_fd = request.fd;
+    return 0;
+}
+
+static void fill_report(struct sevenseg_frame *report) {
+    memset(report->segments, 0, sizeof(report->segments));
+    memcpy(report->segments, framebuffer, number_of_digits * sizeof(framebuffer[0]));
+    report->seq = frame_seq;
+    report->latch_ns = frame_latch_ns;
+}
+
+/**
+ * Único caminho de escrita, como o apply_frame() do driver. Sem varredura o
+ * quadro vai direto para as linhas
+ */
+static void apply_frame(const __u64 *frame, const __u64 *mask, struct sevenseg_frame *report) {
+    pthread_mutex_lock(&frame_lock);
+    for (int d = 0; d < number_of_digits; d++) {
+        __u64 m = mask ? mask[d] : all_segments();
+
+        framebuffer[d] = (framebuffer[d] & ~m) | (frame[d] & m);
+    }
+    if (number_of_digit_pins == 0) {
+        write_lines(framebuffer[0], mask ? mask[0] : all_segments());
+    }
+    frame_latch_ns = now_ns(CLOCK_MONOTONIC);
+    frame_seq++;
+    if (report) {
+        fill_report(report);
+    }
+    pthread_cond_broadcast(&frame_changed);
+    pthread_mutex_unlock(&frame_lock);
+}
+
+/**
+ * Dorme até o instante 'when_ns' (CLOCK_MONOTONIC) em fatias de no máximo
+ * SLEEP_SLICE_NS, olhando entre elas se o pedido foi interrompido por um sinal
+ * no processo que o fez. A última fatia termina exatamente no instante pedido.
+ * Retorna false se o pedido foi interrompido antes disso
+ */
+#define SLEEP_SLICE_NS (10 * 1000000ULL)
+
+static bool sleep_until(fuse_req_t req, __u64 when_ns) {
+    for (;;) {
+        __u64 now = now_ns(CLOCK_MONOTONIC);
+        __u64 until = when_ns;
+        struct timespec slice;
+
+        if (fuse_req_interrupted(req)) {
+            return false;
+        }
+        if (now >= when_ns) {
+            return true;
+        }
+        if (when_ns - now > SLEEP_SLICE_NS) {
+            until = now + SLEEP_SLICE_NS;
+        }
+        slice.tv_sec = until / NSEC_PER_SEC;
+        slice.tv_nsec = until % NSEC_PER_SEC;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &slice, NULL);  // EINTR só encurta a fatia
+    }
+}
+
+/**
+ * Sinal no processo que espera em WAIT_CHANGE: acorda os que esperam para que o
+ * pedido interrompido responda EINTR, como o wait_event_interruptible() do driver
+ */
+static void wait_interrupted(fuse_req_t req, void *data) {
+    pthread_mutex_lock(&frame_lock);
+    pthread_cond_broadcast(&frame_changed);
+    pthread_mutex_unlock(&frame_lock);
+}
+
+/**
+ * Varredura dos dígitos: a cada passo, uma ioctl apaga o dígito anterior,
+ * troca os segmentos e acende o próximo
+ */
+static void *scan_thread(void *data) {
+    __u64 period_ns = NSEC_PER_SEC / (options.refresh_hz * number_of_digits);
+    __u64 lines = all_segments() | (((1ULL << number_of_digit_pins) - 1) << number_of_pins);
+    struct timespec next;
+    int digit = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        __u64 segments;
+
+        pthread_mutex_lock(&frame_lock);
+        segments = framebuffer[digit];
+        pthread_mutex_unlock(&frame_lock);
+        write_lines(segments | (1ULL << (number_of_pins + digit)), lines);
+        digit = (digit + 1) % number_of_digits;
+
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= (long)NSEC_PER_SEC) {
+            next.tv_nsec -= NSEC_PER_SEC;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+static int start_scan(void) {
+    pthread_t scanner;
+
+    if (line_fd < 0 || number_of_digit_pins == 0) {
+        return 0;
+    }
+    if (pthread_create(&scanner, NULL, scan_thread, NULL)) {
+        fprintf(stderr, "sevenseg-cuse: falha ao criar a thread de varredura\n");
+        return -1;
+    }
+    pthread_detach(scanner);
+    return 0;
+}
+
+/**
+ * Mesmo formato de texto do driver: um grupo de '0'/'1' por dígito, separados por espaço
+ */
+static bool parse_message(const char *message, size_t len, __u64 *frame, __u64 *mask) {
+    int digit = 0, segment = 0;
+    bool any = false;
+
+    for (size_t i = 0; i < len && message[i] != '\0' && message[i] != '\n'; i++) {
+        if (message[i] == ' ') {
+            if (++digit >= number_of_digits) {
+                break;
+            }
+            segment = 0;
+            continue;
+        }
+        if (segment >= number_of_pins) {
+            continue;
+        }
+        mask[digit] |= 1ULL << segment;
+        if (message[i] == '1') {
+            frame[digit] |= 1ULL << segment;
+        }
+        segment++;
+        any = true;
+    }
+    return any;
+}
+
+/**
+ * A thread de varredura só nasce aqui: sem -f, o cuse_lowlevel_main() passa o
+ * processo para segundo plano com fork(), e uma thread criada antes ficaria no pai
+ */
+static void cuse_init(void *userdata, struct fuse_conn_info *conn) {
+    if (start_scan()) {
+        exit(1);
+    }
+}
+
+static void cuse_open(fuse_req_t req, struct fuse_file_info *fi) {
+    fi->direct_io = 1;      // Sem cache de página: cada read() vê o quadro atual (pread() no offset 0 relê, como no driver)
+    fuse_reply_open(req, fi);
+}
+
+static void cuse_read(fuse_req_t req, size_t size, off_t off, struct fuse_file_info *fi) {
+    char text[SEVENSEG_MAX_DIGITS * (SEVENSEG_MAX_LINES + 1)];
+    int len = 0;
+
+    if (off > 0) {
+        fuse_reply_buf(req, NULL, 0);   // Uma leitura por abertura, como no driver
+        return;
+    }
+    pthread_mutex_lock(&frame_lock);
+    for (int d = 0; d < number_of_digits; d++) {
+        if (d > 0) {
+            text[len++] = ' ';
+        }
+        for (int i = 0; i < number_of_pins; i++) {
+            text[len++] = (framebuffer[d] >> i) & 1 ? '1' : '0';
+        }
+    }
+    pthread_mutex_unlock(&frame_lock);
+    text[len++] = '\0';
+    fuse_reply_buf(req, text, len < (int)size ? (size_t)len : size);
+}
+
+/**
+ * Um quadro por linha, como o write() comum do driver
+ */
+static void cuse_write(fuse_req_t req, const char *buf, size_t size, off_t off, struct fuse_file_info *fi) {
+    size_t start = 0;
+
+    while (start < size) {
+        const char *end = memchr(buf + start, '\n', size - start);
+        size_t len = end ? (size_t)(end - buf) - start : size - start;
+        __u64 frame[SEVENSEG_MAX_DIGITS] = {0}, mask[SEVENSEG_MAX_DIGITS] = {0};
+
+        if (parse_message(buf + start, len, frame, mask)) {
+            apply_frame(frame, mask, NULL);
+        }
+        start += len + 1;
+    }
+    fuse_reply_write(req, size);
+}
+
+static void cuse_ioctl(fuse_req_t req, int cmd, void *arg, struct fuse_file_info *fi, unsigned flags,
+                       const void *in_buf, size_t in_bufsz, size_t out_bufsz) {
+    struct sevenseg_timed_frame timed;
+    struct sevenseg_frame frame;
+
+    switch ((unsigned int)cmd) {
+    case SEVENSEG_IOC_GET_FRAME:
+        pthread_mutex_lock(&frame_lock);
+        fill_report(&frame);
+        pthread_mutex_unlock(&frame_lock);
+        fuse_reply_ioctl(req, 0, &frame, sizeof(frame));
+        break;
+
+    case SEVENSEG_IOC_SET_FRAME:
+        if (in_bufsz < sizeof(frame)) {
+            fuse_reply_err(req, EINVAL);
+            break;
+        }
+        memcpy(&frame, in_buf, sizeof(frame));
+        apply_frame(frame.segments, NULL, &frame);
+        fuse_reply_ioctl(req, 0, &frame, sizeof(frame));
+        break;
+
+    case SEVENSEG_IOC_SET_FRAME_AT:
+        if (in_bufsz < sizeof(timed)) {
+            fuse_reply_err(req, EINVAL);
+            break;
+        }
+        memcpy(&timed, in_buf, sizeof(timed));
+        if (!sleep_until(req, timed.when_ns)) {
+            fuse_reply_err(req, EINTR);     // Como no driver: interrompido, o quadro agendado não é aplicado
+            break;
+        }
+        apply_frame(timed.frame.segments, NULL, &timed.frame);
+        fuse_reply_ioctl(req, 0, &timed, sizeof(timed));
+        break;
+
+    case SEVENSEG_IOC_WAIT_CHANGE:
+        if (in_bufsz < sizeof(frame)) {
+            fuse_reply_err(req, EINVAL);
+            break;
+        }
+        memcpy(&frame, in_buf, sizeof(frame));
+        fuse_req_interrupt_func(req, wait_interrupted, NULL);
+        pthread_mutex_lock(&frame_lock);
+        while (frame_seq == frame.seq && !fuse_req_interrupted(req)) {
+            pthread_cond_wait(&frame_changed, &frame_lock);
+        }
+        if (frame_seq == frame.seq) {
+            pthread_mutex_unlock(&frame_lock);
+            fuse_reply_err(req, EINTR);
+            break;
+        }
+        fill_report(&frame);
+        pthread_mutex_unlock(&frame_lock);
+        fuse_reply_ioctl(req, 0, &frame, sizeof(frame));
+        break;
+
+    default:
+        fuse_reply_err(req, ENOTTY);    // Animações, contador e agendamento só existem no driver
+        break;
+    }
+}
+
+static void cuse_poll(fuse_req_t req, struct fuse_file_info *fi, struct fuse_pollhandle *ph) {
+    fuse_pollhandle_destroy(ph);
+    fuse_reply_poll(req, POLLOUT | POLLWRNORM);
+}
+
+static const struct cuse_lowlevel_ops cuse_ops = {
+    .init = cuse_init,
+    .open = cuse_open,
+    .read = cuse_read,
+    .write = cuse_write,
+    .ioctl = cuse_ioctl,
+    .poll = cuse_poll,
+};
+
+static int compare_u32(const void *a, const void *b) {
+    __u32 x = *(const __u32 *)a, y = *(const __u32 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static __u32 percentile(const __u32 *sorted, __u64 count, unsigned int per_mille) {
+    return count ? sorted[count * per_mille / 1000 - (per_mille == 1000)] : 0;
+}
+
+/**
+ * Mesmo laço e mesmo relatório do bench do debugfs: cada quadro inverte todas as linhas
+ */
+static int run_bench(const char *spec) {
+    unsigned int duration_ms = 0, rate_hz = 0;
+    __u64 pattern = 0x5555555555555555ULL, frames = 0, samples = 0;
+    __u64 start, end, cpu_start, elapsed, cpu;
+    __u64 frame[SEVENSEG_MAX_DIGITS];
+    struct timespec next;
+    __u32 *latency;
+
+    if (sscanf(spec, "%u,%u", &duration_ms, &rate_hz) < 1 || duration_ms == 0) {
+        fprintf(stderr, "sevenseg-cuse: use --bench=duracao_ms[,taxa_hz]\n");
+        return 1;
+    }
+    latency = malloc(BENCH_MAX_SAMPLES * sizeof(*latency));
+    if (!latency) {
+        return 1;
+    }
+
+    cpu_start = now_ns(CLOCK_THREAD_CPUTIME_ID);
+    start = now_ns(CLOCK_MONOTONIC);
+    end = start + (__u64)duration_ms * 1000000;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        __u64 before, now;
+
+        for (int d = 0; d < number_of_digits; d++) {
+            frame[d] = pattern & all_segments();
+        }
+        pattern = ~pattern;
+        before = now_ns(CLOCK_MONOTONIC);
+        apply_frame(frame, NULL, NULL);
+        now = now_ns(CLOCK_MONOTONIC);
+        if (samples < BENCH_MAX_SAMPLES) {
+            latency[samples++] = now - before > UINT32_MAX ? UINT32_MAX : now - before;
+        }
+        frames++;
+        if (now >= end) {
+            break;
+        }
+        if (rate_hz) {
+            next.tv_nsec += NSEC_PER_SEC / rate_hz;
+            while (next.tv_nsec >= (long)NSEC_PER_SEC) {
+                next.tv_nsec -= NSEC_PER_SEC;
+                next.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+    elapsed = now_ns(CLOCK_MONOTONIC) - start;
+    cpu = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+    qsort(latency, samples, sizeof(*latency), compare_u32);
+    printf("frames: %llu\n", (unsigned long long)frames);
+    printf("elapsed_ns: %llu\n", (unsigned long long)elapsed);
+    printf("target_rate_hz: %u\n", rate_hz);
+    printf("frames_per_sec: %llu\n", (unsigned long long)(frames * NSEC_PER_SEC / elapsed));
+    printf("latency_p50_ns: %u\n", percentile(latency, samples, 500));
+    printf("latency_p90_ns: %u\n", percentile(latency, samples, 900));
+    printf("latency_p99_ns: %u\n", percentile(latency, samples, 990));
+    printf("latency_p999_ns: %u\n", percentile(latency, samples, 999));
+    printf("latency_max_ns: %u\n", percentile(latency, samples, 1000));
+    printf("cpu_percent: %llu\n", (unsigned long long)(cpu * 100 / elapsed));
+    printf("pins_held: %d\n", line_fd >= 0);
+    free(latency);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    char dev_name[128];
+    const char *dev_info_argv[] = { dev_name };
+    struct cuse_info ci;
+    int result;
+
+    if (fuse_opt_parse(&args, &options, option_spec, NULL)) {
+        return 1;
+    }
+    number_of_pins = parse_list(options.pins, segment_lines, SEVENSEG_MAX_LINES);
+    if (number_of_pins < 1) {
+        fprintf(stderr, "sevenseg-cuse: configure de 1 a %d pinos\n", SEVENSEG_MAX_LINES);
+        return 1;
+    }
+    if (options.digit_pins) {
+        number_of_digit_pins = parse_list(options.digit_pins, digit_lines, SEVENSEG_MAX_DIGITS);
+        if (number_of_digit_pins < 0) {
+            fprintf(stderr, "sevenseg-cuse: no maximo %d digitos\n", SEVENSEG_MAX_DIGITS);
+            return 1;
+        }
+    }
+    number_of_digits = number_of_digit_pins > 0 ? number_of_digit_pins : 1;
+    if (options.refresh_hz == 0) {
+        options.refresh_hz = 1;
+    }
+
+    if (options.chip && request_lines()) {
+        return 1;
+    }
+    if (options.bench) {
+        return start_scan() ? 1 : run_bench(options.bench);
+    }
+
+    snprintf(dev_name, sizeof(dev_name), "DEVNAME=%s", options.name);
+    memset(&ci, 0, sizeof(ci));
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = dev_info_argv;
+    result = cuse_lowlevel_main(args.argc, args.argv, &ci, &cuse_ops, NULL);
+    fuse_opt_free_args(&args);
+    return result;
+}
@@ -0,0 +1,268 @@
+/**
+ * sevenseg-play: toca um fluxo de quadros no /dev/sevenseg a uma taxa fixa e, ao
+ * terminar (fim da entrada ou Ctrl+C), mostra a taxa obtida, os quadros descartados
+ * e o jitter (atraso de cada quadro em relação ao seu instante). Serve tanto para
+ * exibir animações gravadas quanto para medir o ritmo de ponta a ponta
+ *
+ * Os quadros vêm de um arquivo ou da entrada padrão, em um destes formatos:
+ *   text    - um quadro por linha, como o write() do driver ("1110111 0110000")
+ *   raw     - SEVENSEG_MAX_DIGITS valores __u64 por quadro (o campo 'segments' de sevenseg.h)
+ *   history - registros struct sevenseg_history_record (/sys/kernel/debug/sevenseg/history)
+ *
+ * O quadro i tem o instante absoluto início + i / fps, e a espera é um
+ * clock_nanosleep(TIMER_ABSTIME) até ele, então atrasos não se acumulam. Um
+ * quadro cujo intervalo inteiro já passou é descartado em vez de atrasar os
+ * seguintes. O envio usa a libsevenseg, que escolhe o ioctl SET_FRAME quando o
+ * módulo o tem. Com --fps=0 os quadros vão o mais rápido possível e o jitter
+ * passa a ser o tempo de cada envio
+ *
+ * Compilação (da pasta do projeto):
+ *   gcc -O2 -Wall -I. -Ilib -o sevenseg-play tools/sevenseg-play.c lib/libsevenseg.c
+ *
+ * Uso:
+ *   ./sevenseg-play --fps=30 animacao.txt
+ *   gerador | ./sevenseg-play --fps=60
+ *   sudo cat /sys/kernel/debug/sevenseg/history > h.bin; ./sevenseg-play --format=history --fps=100 h.bin
+ */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sevenseg.h"
+#include "libsevenseg.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+#define MAX_SAMPLES (1 << 20)
+#define LINE_MAX_LEN (SEVENSEG_MAX_DIGITS * (SEVENSEG_MAX_LINES + 1) + 2)
+
+enum input_format {
+    FORMAT_TEXT,
+    FORMAT_RAW,
+    FORMAT_HISTORY,
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static __u64 now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Converte uma linha de texto em quadro: '1' liga a linha i do dígito, um
+ * espaço passa para o próximo dígito. Retorna false para linhas vazias
+ */
+static bool parse_line(const char *line, uint64_t *frame) {
+    int digit = 0, segment = 0;
+    bool any = false;
+
+    memset(frame, 0, SEVENSEG_MAX_DIGITS * sizeof(*frame));
+    for (const char *c = line; *c != '\0' && *c != '\n' && *c != '\r'; c++) {
+        if (*c == ' ') {
+            if (++digit >= SEVENSEG_MAX_DIGITS) {
+                break;
+            }
+            segment = 0;
+            continue;
+        }
+        if (*c == '1' && segment < SEVENSEG_MAX_LINES) {
+            frame[digit] |= 1ULL << segment;
+        }
+        segment++;
+        any = true;
+    }
+    return any;
+}
+
+/**
+ * Lê o próximo quadro da entrada. Retorna false no fim (ou em um registro incompleto)
+ */
+static bool next_frame(FILE *input, enum input_format format, uint64_t *frame) {
+    struct sevenseg_history_record record;
+    char line[LINE_MAX_LEN];
+
+    switch (format) {
+    case FORMAT_RAW:
+        return fread(frame, sizeof(uint64_t), SEVENSEG_MAX_DIGITS, input) == SEVENSEG_MAX_DIGITS;
+    case FORMAT_HISTORY:
+        if (fread(&record, sizeof(record), 1, input) != 1) {
+            return false;
+        }
+        memcpy(frame, record.segments, sizeof(record.segments));
+        return true;
+    default:
+        while (fgets(line, sizeof(line), input)) {
+            if (parse_line(line, frame)) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+static int compare_u32(const void *a, const void *b) {
+    __u32 x = *(const __u32 *)a, y = *(const __u32 *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static __u32 percentile(const __u32 *sorted, __u64 count, unsigned int per_mille) {
+    return count ? sorted[count * per_mille / 1000 - (per_mille == 1000)] : 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "uso: sevenseg-play [--device=/dev/sevenseg] [--fps=30] [--format=text|raw|history] [arquivo]\n");
+}
+
+int main(int argc, char **argv) {
+    static const struct option long_options[] = {
+        { "device", required_argument, NULL, 'd' },
+        { "fps", required_argument, NULL, 'r' },
+        { "format", required_argument, NULL, 'f' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    const char *device = NULL;
+    enum input_format format = FORMAT_TEXT;
+    unsigned int fps = 30;
+    uint64_t frame[SEVENSEG_MAX_DIGITS];
+    __u64 period, start, elapsed, index = 0, shown = 0, dropped = 0, samples = 0;
+    struct sigaction action = { .sa_handler = on_signal };
+    struct sevenseg *display;
+    FILE *input = stdin;
+    __u32 *lateness;
+    int opt, ret;
+
+    while ((opt = getopt_long(argc, argv, "d:r:f:h", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'd':
+            device = optarg;
+            break;
+        case 'r': {
+            unsigned long value;
+            char *end;
+
+            errno = 0;
+            value = strtoul(optarg, &end, 10);
+            if (errno || end == optarg || *end != '\0' || *optarg == '-' || value > UINT32_MAX) {
+                fprintf(stderr, "sevenseg-play: --fps invalido: %s\n", optarg);
+                usage();
+                return 1;
+            }
+            fps = value;
+            break;
+        }
+        case 'f':
+            if (!strcmp(optarg, "text")) {
+                format = FORMAT_TEXT;
+            } else if (!strcmp(optarg, "raw")) {
+                format = FORMAT_RAW;
+            } else if (!strcmp(optarg, "history")) {
+                format = FORMAT_HISTORY;
+            } else {
+                usage();
+                return 1;
+            }
+            break;
+        default:
+            usage();
+            return opt != 'h';
+        }
+    }
+    if (optind < argc && strcmp(argv[optind], "-")) {
+        input = fopen(argv[optind], format == FORMAT_TEXT ? "r" : "rb");
+        if (!input) {
+            perror(argv[optind]);
+            return 1;
+        }
+    }
+
+    display = sevenseg_open(device);
+    if (!display) {
+        perror(device ? device : "/dev/sevenseg");
+        return 1;
+    }
+    lateness = malloc(MAX_SAMPLES * sizeof(*lateness));
+    if (!lateness) {
+        sevenseg_close(display);
+        return 1;
+    }
+    sigaction(SIGINT, &action, NULL);   // Sem SA_RESTART: o Ctrl+C interrompe a espera e ainda mostramos o relatório
+    sigaction(SIGTERM, &action, NULL);
+
+    period = fps ? NSEC_PER_SEC / fps : 0;
+    start = now_ns();
+    while (!stop && next_frame(input, format, frame)) {
+        __u64 deadline = period ? start + index++ * period : now_ns();
+        struct timespec ts = {
+            .tv_sec = deadline / NSEC_PER_SEC,
+            .tv_nsec = deadline % NSEC_PER_SEC,
+        };
+        __u64 done;
+
+        if (period && now_ns() >= deadline + period) {
+            dropped++;          // O intervalo deste quadro já passou: mostrá-lo só atrasaria os próximos
+            continue;
+        }
+        if (period) {
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop) {
+            }
+            if (stop) {
+                break;
+            }
+        }
+        ret = sevenseg_set(display, frame, SEVENSEG_MAX_DIGITS);
+        if (ret < 0) {
+            fprintf(stderr, "sevenseg-play: falha ao aplicar quadro: %s\n", strerror(-ret));
+            break;
+        }
+        done = now_ns();
+        if (samples < MAX_SAMPLES) {
+            lateness[samples++] = done - deadline > UINT32_MAX ? UINT32_MAX : done - deadline;
+        }
+        shown++;
+    }
+    // Com taxa fixa, o último quadro ocupa o display até o fim do seu intervalo: medir só até o
+    // último envio cobriria um período a menos e inflaria frames_per_sec
+    elapsed = now_ns();
+    if (period && start + index * period > elapsed) {
+        elapsed = start + index * period;
+    }
+    elapsed -= start;
+
+    qsort(lateness, samples, sizeof(*lateness), compare_u32);
+    printf("interface: %s\n", sevenseg_interface(display) == SEVENSEG_IF_IOCTL ? "ioctl" : "text");
+    printf("frames: %llu\n", (unsigned long long)shown);
+    printf("dropped: %llu\n", (unsigned long long)dropped);
+    printf("elapsed_ns: %llu\n", (unsigned long long)elapsed);
+    printf("target_fps: %u\n", fps);
+    printf("frames_per_sec: %llu.%02llu\n", (unsigned long long)(elapsed ? shown * NSEC_PER_SEC / elapsed : 0),
+           (unsigned long long)(elapsed ? shown * NSEC_PER_SEC * 100 / elapsed % 100 : 0));
+    printf("jitter_p50_ns: %u\n", percentile(lateness, samples, 500));
+    printf("jitter_p90_ns: %u\n", percentile(lateness, samples, 900));
+    printf("jitter_p99_ns: %u\n", percentile(lateness, samples, 990));
+    printf("jitter_p999_ns: %u\n", percentile(lateness, samples, 999));
+    printf("jitter_max_ns: %u\n", percentile(lateness, samples, 1000));
+
+    free(lateness);
+    sevenseg_close(display);
+    if (input != stdin) {
+        fclose(input);
+    }
+    return 0;
+}